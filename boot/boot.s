@@ -1,18 +1,88 @@
 # Multiboot header
-.section .multiboot
+.set MB_MAGIC,        0x1BADB002   # magic number for Multiboot
+.set MB_FLAG_ALIGN,   1 << 0       # load modules on page boundaries
+.set MB_FLAG_MEMINFO, 1 << 1       # provide mem_* fields and the memory map
+.set MB_FLAGS,        MB_FLAG_ALIGN | MB_FLAG_MEMINFO
+
+# Higher-half layout (must match kernel/include/memlayout.h)
+.set KERNEL_VIRT_BASE, 0xC0000000
+.set KERNEL_PDE_INDEX, KERNEL_VIRT_BASE >> 22
+.set DIRECT_MAP_PAGES, 192         # 768 MiB of 4 MiB pages
+.set PDE_LARGE_RW,     0x83        # present | writable | 4 MiB page
+.set BOOT_STACK_SIZE,  16384
+
+# Allocated so the linker places it at the very start of the file, where
+# the bootloader searches for it (first 8 KiB)
+.section .multiboot, "a"
     .align 4
-    .long 0x1BADB002               # magic number for Multiboot
-    .long 0x0                      # flags (we use 0 here for simplicity)
-    .long -(0x1BADB002)            # checksum to make the header zero
+    .long MB_MAGIC
+    .long MB_FLAGS
+    .long -(MB_MAGIC + MB_FLAGS)   # checksum to make the header zero
 
-# Entry point
-.section .text
+# Entry point, linked and run at its physical load address
+.section .boot.text, "ax"
 .global _start
 _start:
-    mov $kernel_main, %eax         # Load address of kernel_main
-    call *%eax                     # Call kernel_main
+    # EAX (magic) and EBX (info pointer) must survive until kernel_main
+    mov $(boot_page_directory - KERNEL_VIRT_BASE), %edi
+
+    # Identity map the first 4 MiB so this code keeps running after paging is on
+    movl $PDE_LARGE_RW, (%edi)
+
+    # Map physical memory at KERNEL_VIRT_BASE with 4 MiB pages
+    xor %ecx, %ecx
+    mov $PDE_LARGE_RW, %edx
+1:
+    mov %edx, (KERNEL_PDE_INDEX * 4)(%edi, %ecx, 4)
+    add $0x400000, %edx
+    inc %ecx
+    cmp $DIRECT_MAP_PAGES, %ecx
+    jne 1b
+
+    # Load directory, enable 4 MiB pages, then paging and write protection.
+    # PSE is not optional: every PDE above is a 4 MiB page, and so is the
+    # kernel's own direct map (paging_init)
+    mov %edi, %cr3
+    mov %cr4, %ecx
+    or $0x10, %ecx                 # CR4.PSE
+    mov %ecx, %cr4
+    mov %cr0, %ecx
+    or $0x80010000, %ecx           # CR0.PG | CR0.WP
+    mov %ecx, %cr0
+
+    # Absolute jump into the higher half
+    mov $higher_half, %ecx
+    jmp *%ecx
+
+.section .text
+higher_half:
+    mov $boot_stack_top, %esp      # Switch to the kernel's own stack
+    xor %ebp, %ebp                 # Terminate frame pointer chain
+
+    push %ebx                      # Multiboot info structure (physical address)
+    push %eax                      # Bootloader magic (0x2BADB002)
+    call kernel_main               # Call kernel_main(magic, mbi)
 
 halt:
     hlt                            # Halt the CPU
     jmp halt                       # Infinite loop
 
+.section .bss
+.align 4096
+.global boot_page_directory
+boot_page_directory:
+    .skip 4096
+
+# Boot stack in its own 4 MiB region (see linker.ld). The guard page below
+# it is unmapped by paging_init so an overflow faults instead of corrupting
+# whatever would otherwise sit below the stack.
+.section .stack, "aw", @nobits
+.align 4096
+.global boot_stack_guard
+boot_stack_guard:
+    .skip 4096
+.global boot_stack_bottom
+boot_stack_bottom:
+    .skip BOOT_STACK_SIZE
+.global boot_stack_top
+boot_stack_top:
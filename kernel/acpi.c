@@ -0,0 +1,142 @@
+#include "include/acpi.h"
+#include "include/paging.h"
+#include "include/memlayout.h"
+#include "include/string.h"
+
+// ACPI table discovery
+//
+// Only what interrupt routing and SMP need is read: the RSDP is found in the
+// EBDA or the BIOS area, the RSDT points at the MADT, and the MADT's entries
+// are copied into acpi_madt_info. Tables usually sit in low RAM covered by
+// the direct map; anything past the RAM it maps goes through the MMIO window.
+
+static struct acpi_madt_info madt_info;
+static int madt_found = 0;
+
+static int checksum_ok(const void* data, uint32_t length) {
+    const uint8_t* bytes = data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+// Virtual address for length bytes of a physical table
+static const void* map_table(uint32_t phys, uint32_t length) {
+    if (phys + length <= paging_direct_map_end()) {
+        return (const void*)PHYS_TO_VIRT(phys);
+    }
+    return (const void*)paging_map_mmio(phys, length);
+}
+
+static const struct acpi_rsdp* scan_rsdp(uint32_t start, uint32_t length) {
+    for (uint32_t addr = start; addr < start + length; addr += 16) {
+        const struct acpi_rsdp* rsdp = (const struct acpi_rsdp*)PHYS_TO_VIRT(addr);
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && checksum_ok(rsdp, 20)) {
+            return rsdp;
+        }
+    }
+    return 0;
+}
+
+static const struct acpi_rsdp* find_rsdp(void) {
+    // First KiB of the EBDA, whose segment is stored in the BIOS data area
+    uint32_t ebda = (uint32_t)(*(const uint16_t*)PHYS_TO_VIRT(0x40E)) << 4;
+    const struct acpi_rsdp* rsdp = 0;
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        rsdp = scan_rsdp(ebda, 1024);
+    }
+    if (rsdp == 0) {
+        rsdp = scan_rsdp(0xE0000, 0x20000);
+    }
+    return rsdp;
+}
+
+// Map a table whose header is at phys, checking its signature and checksum
+static const struct acpi_header* map_sdt(uint32_t phys, const char* signature) {
+    const struct acpi_header* header = map_table(phys, sizeof(struct acpi_header));
+    if (header == 0 || (signature && memcmp(header->signature, signature, 4) != 0)) {
+        return 0;
+    }
+
+    header = map_table(phys, header->length);
+    if (header == 0 || !checksum_ok(header, header->length)) {
+        return 0;
+    }
+    return header;
+}
+
+static void parse_madt(const struct acpi_header* madt) {
+    const uint8_t* table = (const uint8_t*)madt;
+    const uint8_t* entry = table + sizeof(struct acpi_header) + 8;
+    const uint8_t* end = table + madt->length;
+
+    madt_info.lapic_phys = *(const uint32_t*)(table + sizeof(struct acpi_header));
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        madt_info.isa_gsi[irq] = irq;
+    }
+
+    while (entry + 2 <= end && entry[1] >= 2) {
+        switch (entry[0]) {
+        case MADT_LOCAL_APIC:
+            // processor id, APIC id, flags
+            if ((*(const uint32_t*)(entry + 4) & MADT_LAPIC_ENABLED) && madt_info.cpu_count < MAX_CPUS) {
+                madt_info.cpu_apic_ids[madt_info.cpu_count++] = entry[3];
+            }
+            break;
+        case MADT_IO_APIC:
+            // id, reserved, address, GSI base
+            if (madt_info.ioapic_count < ACPI_MAX_IOAPICS) {
+                struct acpi_ioapic* ioapic = &madt_info.ioapics[madt_info.ioapic_count++];
+                ioapic->id = entry[2];
+                ioapic->phys_addr = *(const uint32_t*)(entry + 4);
+                ioapic->gsi_base = *(const uint32_t*)(entry + 8);
+            }
+            break;
+        case MADT_INT_OVERRIDE:
+            // bus (0 = ISA), source IRQ, GSI, flags
+            if (entry[2] == 0 && entry[3] < ACPI_ISA_IRQS) {
+                madt_info.isa_gsi[entry[3]] = *(const uint32_t*)(entry + 4);
+                madt_info.isa_flags[entry[3]] = *(const uint16_t*)(entry + 8);
+            }
+            break;
+        case MADT_LAPIC_ADDR:
+            // 64-bit override, only usable below 4 GiB
+            if (*(const uint32_t*)(entry + 8) == 0) {
+                madt_info.lapic_phys = *(const uint32_t*)(entry + 4);
+            }
+            break;
+        }
+        entry += entry[1];
+    }
+}
+
+int acpi_init(void) {
+    const struct acpi_rsdp* rsdp = find_rsdp();
+    if (rsdp == 0) {
+        return 0;
+    }
+
+    const struct acpi_header* rsdt = map_sdt(rsdp->rsdt_addr, "RSDT");
+    if (rsdt == 0) {
+        return 0;
+    }
+
+    // Mappings are never torn down, so the RSDT stays readable while walking it
+    uint32_t count = (rsdt->length - sizeof(struct acpi_header)) / 4;
+    const uint32_t* entries = (const uint32_t*)(rsdt + 1);
+    for (uint32_t i = 0; i < count; i++) {
+        const struct acpi_header* header = map_sdt(entries[i], "APIC");
+        if (header) {
+            parse_madt(header);
+            madt_found = 1;
+            break;
+        }
+    }
+    return madt_found;
+}
+
+const struct acpi_madt_info* acpi_get_madt(void) {
+    return madt_found ? &madt_info : 0;
+}
@@ -0,0 +1,279 @@
+#include "include/apic.h"
+#include "include/acpi.h"
+#include "include/idt.h"
+#include "include/paging.h"
+#include "include/pmm.h"
+#include "include/cpu.h"
+#include "include/timer.h"
+
+// Local APIC and I/O APIC
+//
+// With the APICs in use an interrupt costs one MMIO write for the EOI instead
+// of one or two port writes to the 8259s, and masking an IRQ is a single
+// write of a precomputed redirection entry rather than a port read-modify-
+// write. Every routed IRQ is sent to the boot CPU in physical destination
+// mode; the 8259s stay remapped but fully masked so their spurious IRQs do
+// not collide with exceptions.
+
+struct ioapic {
+    volatile uint32_t* base;
+    uint32_t gsi_base;
+    uint32_t pins;
+};
+
+// Where an IRQ is routed, with its unmasked redirection entry ready to write
+struct irq_route {
+    struct ioapic* ioapic;    // 0 when the IRQ has no pin
+    uint32_t pin;
+    uint32_t entry;
+};
+
+static volatile uint32_t* lapic = 0;
+static struct ioapic ioapics[ACPI_MAX_IOAPICS];
+static uint32_t ioapic_count = 0;
+static struct irq_route routes[APIC_IRQ_COUNT];
+static int apic_active = 0;
+static uint32_t lapic_timer_count = 0;   // Initial count for one tick
+
+uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+}
+
+uint32_t lapic_get_id(void) {
+    return lapic ? lapic_read(LAPIC_ID) >> 24 : 0;
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+void lapic_init_cpu(void) {
+    // Hardware-enable the LAPIC (keeping the base the firmware set up)
+    wrmsr(MSR_APIC_BASE, rdmsr(MSR_APIC_BASE) | MSR_APIC_BASE_ENABLE);
+
+    // Accept all priorities, no virtual-wire ExtINT, NMI on LINT1
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    lapic_eoi();
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint32_t command) {
+    // The two ICR writes must not be split by an interrupt sending its own IPI
+    uint32_t flags = irq_save();
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+        cpu_relax();
+    }
+    irq_restore(flags);
+}
+
+void lapic_timer_calibrate(uint32_t hz) {
+    if (!apic_active || hz == 0) {
+        return;
+    }
+
+    // Count down from the top for a fixed time, masked
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    timer_delay_us(LAPIC_CALIBRATE_US);
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_COUNT);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    lapic_timer_count = elapsed * (1000000 / LAPIC_CALIBRATE_US) / hz;
+}
+
+void lapic_timer_start(void) {
+    if (lapic_timer_count == 0) {
+        return;
+    }
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR | LAPIC_LVT_PERIODIC);
+    lapic_write(LAPIC_TIMER_INIT, lapic_timer_count);
+}
+
+int lapic_timer_set_rate(uint32_t multiplier) {
+    if (lapic_timer_count == 0) {
+        return 0;
+    }
+    if (multiplier == 0) {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+        lapic_write(LAPIC_TIMER_INIT, 0);
+        return 1;
+    }
+    uint32_t count = lapic_timer_count / multiplier;
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR | LAPIC_LVT_PERIODIC);
+    lapic_write(LAPIC_TIMER_INIT, count ? count : 1);
+    return 1;
+}
+
+uint32_t lapic_timer_tick_count(void) {
+    return lapic_timer_count;
+}
+
+void lapic_timer_oneshot(uint32_t count) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INIT, count ? count : 1);
+}
+
+uint32_t lapic_timer_remaining(void) {
+    return lapic_read(LAPIC_TIMER_COUNT);
+}
+
+static uint32_t ioapic_read(struct ioapic* io, uint32_t reg) {
+    io->base[IOAPIC_REGSEL / 4] = reg;
+    return io->base[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(struct ioapic* io, uint32_t reg, uint32_t value) {
+    io->base[IOAPIC_REGSEL / 4] = reg;
+    io->base[IOAPIC_WINDOW / 4] = value;
+}
+
+static struct ioapic* ioapic_for_gsi(uint32_t gsi) {
+    for (uint32_t i = 0; i < ioapic_count; i++) {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].pins) {
+            return &ioapics[i];
+        }
+    }
+    return 0;
+}
+
+void ioapic_set_mask(uint32_t irq, int masked) {
+    if (irq >= APIC_IRQ_COUNT || routes[irq].ioapic == 0) {
+        return;
+    }
+    struct irq_route* route = &routes[irq];
+    uint32_t entry = route->entry | (masked ? IOAPIC_MASKED : 0);
+    ioapic_write(route->ioapic, IOAPIC_REG_REDIR + route->pin * 2, entry);
+}
+
+// Work out the pin, polarity and trigger mode of every IRQ
+static void route_irqs(const struct acpi_madt_info* madt, uint32_t dest) {
+    for (uint32_t irq = 0; irq < APIC_IRQ_COUNT; irq++) {
+        uint32_t gsi = irq;
+        uint32_t entry = IRQ_OFFSET + irq;
+
+        if (irq < ACPI_ISA_IRQS) {
+            gsi = madt->isa_gsi[irq];
+
+            // Pin taken over by another ISA IRQ's override (IRQ2 when IRQ0 moves to GSI2)
+            int taken = 0;
+            for (uint32_t other = 0; other < ACPI_ISA_IRQS; other++) {
+                if (other != irq && madt->isa_gsi[other] == gsi && madt->isa_gsi[other] != other) {
+                    taken = 1;
+                }
+            }
+            if (taken) {
+                continue;
+            }
+
+            // ISA defaults to active-high edge unless overridden
+            uint16_t flags = madt->isa_flags[irq];
+            if ((flags & MADT_POLARITY_MASK) == MADT_POLARITY_LOW) {
+                entry |= IOAPIC_POLARITY_LOW;
+            }
+            if ((flags & MADT_TRIGGER_MASK) == MADT_TRIGGER_LEVEL) {
+                entry |= IOAPIC_TRIGGER_LEVEL;
+            }
+        } else {
+            // Pin claimed by an ISA IRQ's override
+            int taken = 0;
+            for (uint32_t isa = 0; isa < ACPI_ISA_IRQS; isa++) {
+                if (madt->isa_gsi[isa] == gsi) {
+                    taken = 1;
+                }
+            }
+            if (taken) {
+                continue;
+            }
+
+            // PCI interrupt lines are active-low and level triggered
+            entry |= IOAPIC_POLARITY_LOW | IOAPIC_TRIGGER_LEVEL;
+        }
+
+        struct ioapic* io = ioapic_for_gsi(gsi);
+        if (io == 0) {
+            continue;
+        }
+
+        routes[irq].ioapic = io;
+        routes[irq].pin = gsi - io->gsi_base;
+        routes[irq].entry = entry;
+        ioapic_write(io, IOAPIC_REG_REDIR + routes[irq].pin * 2 + 1, dest << 24);
+        ioapic_set_mask(irq, 1);
+    }
+}
+
+int apic_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_APIC) || !(edx & CPUID_FEAT_EDX_MSR) || !acpi_init()) {
+        return 0;
+    }
+
+    const struct acpi_madt_info* madt = acpi_get_madt();
+    if (madt->ioapic_count == 0) {
+        return 0;
+    }
+
+    lapic = (volatile uint32_t*)paging_map_mmio(madt->lapic_phys, PAGE_SIZE);
+    if (lapic == 0) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < madt->ioapic_count; i++) {
+        struct ioapic* io = &ioapics[ioapic_count];
+        io->base = (volatile uint32_t*)paging_map_mmio(madt->ioapics[i].phys_addr, PAGE_SIZE);
+        if (io->base == 0) {
+            continue;
+        }
+        io->gsi_base = madt->ioapics[i].gsi_base;
+        io->pins = ((ioapic_read(io, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+
+        // Start with every pin masked
+        for (uint32_t pin = 0; pin < io->pins; pin++) {
+            ioapic_write(io, IOAPIC_REG_REDIR + pin * 2, IOAPIC_MASKED);
+        }
+        ioapic_count++;
+    }
+    if (ioapic_count == 0) {
+        return 0;
+    }
+
+    uint32_t flags = irq_save();
+
+    // Hardware-enable the LAPIC at the address the MADT gave us. Only the
+    // base field is ours to change; the BSP flag, x2APIC mode and the upper
+    // base bits above 4 GiB are left as the firmware set them.
+    uint64_t apic_base = rdmsr(MSR_APIC_BASE) & ~0xFFFFF000ull;
+    apic_base |= madt->lapic_phys & 0xFFFFF000;
+    wrmsr(MSR_APIC_BASE, apic_base | MSR_APIC_BASE_ENABLE);
+    lapic_init_cpu();
+
+    route_irqs(madt, lapic_get_id());
+
+    // The 8259s stay remapped but silent
+    pic_disable();
+    apic_active = 1;
+
+    irq_restore(flags);
+    return 1;
+}
+
+int apic_enabled(void) {
+    return apic_active;
+}
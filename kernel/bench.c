@@ -0,0 +1,245 @@
+#include "include/bench.h"
+#include "include/thread.h"
+#include "include/cpu.h"
+#include "include/div64.h"
+#include "include/heap.h"
+#include "include/timer_wheel.h"
+#include "include/tsc.h"
+#include "include/atomic.h"
+#include "include/waitqueue.h"
+#include "include/string.h"
+
+// In-kernel micro-benchmarks, timed with the TSC
+
+static void bench_finish(struct bench_result* out, uint32_t ops, uint64_t cycles) {
+    out->ops = ops;
+    out->cycles = cycles;
+    out->cycles_per_op = ops ? (uint32_t)div_u64(cycles, ops) : 0;
+    out->ns_per_op = ops ? (uint32_t)div_u64(tsc_to_ns(cycles), ops) : 0;
+}
+
+static volatile int switch_done;
+
+static void switch_partner(void* arg) {
+    (void)arg;
+    while (!switch_done) {
+        thread_yield();
+    }
+}
+
+// Context switch cost: the caller and a partner thread yield to each other.
+// Switches are counted by the scheduler, so other ready threads only dilute
+// the average instead of skewing the count. The partner is pinned so no idle
+// CPU steals it away from the ping-pong.
+int bench_switch(uint32_t iterations, struct bench_result* out) {
+    switch_done = 0;
+    if (thread_create_pinned("bench", switch_partner, 0) == 0) {
+        return 0;
+    }
+
+    // Let the partner start so its first-run setup is not measured
+    thread_yield();
+
+    uint32_t start_switches = thread_context_switches();
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < iterations; i++) {
+        thread_yield();
+    }
+    uint64_t cycles = rdtsc() - start;
+    uint32_t switches = thread_context_switches() - start_switches;
+
+    switch_done = 1;
+    thread_yield();
+
+    bench_finish(out, switches, cycles);
+    return 1;
+}
+
+static volatile uint32_t parallel_left;
+static uint32_t parallel_work;
+static volatile uint32_t parallel_sink;
+static struct wait_queue parallel_done = WAIT_QUEUE_INIT;
+
+static void parallel_worker(void* arg) {
+    uint32_t x = (uint32_t)arg + 1;
+    for (uint32_t i = 0; i < parallel_work; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    parallel_sink += x;
+
+    if (atomic_add_return(&parallel_left, -1u) == 0) {
+        wake_up_all(&parallel_done);
+    }
+}
+
+// Scheduler scaling: the workers are all created on this CPU, so every other
+// CPU only gets work by stealing it
+int bench_parallel(uint32_t threads, uint32_t work, struct bench_result* out) {
+    int ok = 1;
+    parallel_work = work;
+    parallel_left = threads;
+
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < threads; i++) {
+        if (thread_create("worker", parallel_worker, (void*)i) == 0) {
+            atomic_add_return(&parallel_left, i - threads);
+            ok = 0;
+            break;
+        }
+    }
+
+    uint32_t flags = spin_lock_irqsave(&parallel_done.lock);
+    while (parallel_left) {
+        wait_queue_sleep(&parallel_done);
+    }
+    spin_unlock_irqrestore(&parallel_done.lock, flags);
+
+    bench_finish(out, threads, rdtsc() - start);
+    return ok;
+}
+
+static void bench_timer_expired(void* arg) {
+    (void)arg;
+}
+
+// Timer wheel insert and cancel cost. Delays are scattered from a few ticks
+// to several minutes so every level of the wheel is exercised.
+int bench_timers(uint32_t count, struct bench_result* arm, struct bench_result* cancel) {
+    struct timer* timers = kmalloc(count * sizeof(struct timer));
+    if (timers == 0) {
+        return 0;
+    }
+
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < count; i++) {
+        timer_setup(&timers[i], bench_timer_expired, 0);
+    }
+
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        timer_add(&timers[i], 1000 + (seed >> 8) % 100000);
+    }
+    bench_finish(arm, count, rdtsc() - start);
+
+    start = rdtsc();
+    for (uint32_t i = 0; i < count; i++) {
+        timer_cancel(&timers[i]);
+    }
+    bench_finish(cancel, count, rdtsc() - start);
+
+    kfree(timers);
+    return 1;
+}
+
+// memcpy and memset throughput on one buffer size: the same total amount of
+// data at every size, so small sizes show the per-call overhead. ops is the
+// number of bytes moved.
+int bench_mem(uint32_t size, struct bench_result* copy, struct bench_result* set) {
+    uint8_t* src = kmalloc(size);
+    uint8_t* dst = kmalloc(size);
+    if (src == 0 || dst == 0) {
+        kfree(src);
+        kfree(dst);
+        return 0;
+    }
+
+    uint32_t rounds = BENCH_MEM_TOTAL / size;
+    if (rounds == 0) {
+        rounds = 1;
+    }
+
+    // Touch both buffers first so page faults and cold misses are not timed
+    memset(src, 0x5A, size);
+    memcpy(dst, src, size);
+
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < rounds; i++) {
+        memcpy(dst, src, size);
+    }
+    bench_finish(copy, rounds * size, rdtsc() - start);
+
+    start = rdtsc();
+    for (uint32_t i = 0; i < rounds; i++) {
+        memset(dst, i, size);
+    }
+    bench_finish(set, rounds * size, rdtsc() - start);
+
+    kfree(src);
+    kfree(dst);
+    return 1;
+}
+
+// The byte-at-a-time loops string.c used before its word-at-a-time scans
+static size_t __attribute__((noinline)) strlen_bytes(const char* str) {
+    size_t len = 0;
+    while (str[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+static int __attribute__((noinline)) strcmp_bytes(const char* str1, const char* str2) {
+    while (*str1 && (*str1 == *str2)) {
+        str1++;
+        str2++;
+    }
+    return *(const unsigned char*)str1 - *(const unsigned char*)str2;
+}
+
+static char* __attribute__((noinline)) strcpy_bytes(char* dest, const char* src) {
+    char* orig_dest = dest;
+    while (*src != '\0') {
+        *dest++ = *src++;
+    }
+    *dest = '\0';
+    return orig_dest;
+}
+
+static volatile uint32_t string_sink;
+
+static uint64_t time_string_op(enum bench_string_op op, int fast, char* a, char* b, uint32_t rounds) {
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < rounds; i++) {
+        switch (op) {
+        case BENCH_STRLEN:
+            string_sink = fast ? strlen(a) : strlen_bytes(a);
+            break;
+        case BENCH_STRCMP:
+            string_sink = fast ? strcmp(a, b) : strcmp_bytes(a, b);
+            break;
+        case BENCH_STRCPY:
+            string_sink = (uint32_t)(fast ? strcpy(b, a) : strcpy_bytes(b, a));
+            break;
+        }
+    }
+    return rdtsc() - start;
+}
+
+// One string function on len-character strings, word-at-a-time against the
+// byte loops. a is the source, b an equal string (the destination for strcpy).
+int bench_string(enum bench_string_op op, uint32_t len, struct bench_result* fast, struct bench_result* bytes) {
+    char* a = kmalloc(len + 1);
+    char* b = kmalloc(len + 1);
+    if (a == 0 || b == 0) {
+        kfree(a);
+        kfree(b);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < len; i++) {
+        a[i] = 'a' + i % 26;
+    }
+    a[len] = '\0';
+    memcpy(b, a, len + 1);
+
+    uint32_t rounds = BENCH_STRING_TOTAL / (len + 1);
+    bench_finish(fast, rounds, time_string_op(op, 1, a, b, rounds));
+    bench_finish(bytes, rounds, time_string_op(op, 0, a, b, rounds));
+
+    kfree(a);
+    kfree(b);
+    return 1;
+}
@@ -1,15 +1,34 @@
 #include "include/gdt.h"
+#include "include/cpu.h"
+#include "include/string.h"
+#include "include/percpu.h"
 
-// GDT with 3 entries: null, code, data
-#define GDT_ENTRIES 3
-struct gdt_entry gdt[GDT_ENTRIES];
-struct gdt_ptr gdt_pointer;
+// Each CPU has its own GDT with 6 entries: null, code, data, kernel TSS,
+// double fault TSS and a data segment whose base is the CPU's struct cpu
+// (loaded into %fs, so per-CPU data is one segment-relative load away)
+#define GDT_ENTRIES 6
 
-// External assembly function to load GDT
+// The double fault handler runs as a separate task on its own stack, so a
+// kernel stack overflow (fault on the guard page while pushing the exception
+// frame) still reaches a handler instead of triple faulting.
+#define DF_STACK_SIZE 4096
+
+struct cpu_tables {
+    struct gdt_entry gdt[GDT_ENTRIES];
+    struct gdt_ptr gdt_pointer;
+    struct tss_entry kernel_tss;
+    struct tss_entry double_fault_tss;
+    uint8_t double_fault_stack[DF_STACK_SIZE] __attribute__((aligned(16)));
+};
+
+static struct cpu_tables cpu_tables[MAX_CPUS];
+
+// External assembly functions to load GDT and enter the double fault task
 extern void gdt_flush(uint32_t);
+extern void double_fault_task(void);
 
 // Set a GDT entry
-static void gdt_set_gate(int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
+static void gdt_set_gate(struct gdt_entry* gdt, int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
     // Base address
     gdt[num].base_low = (base & 0xFFFF);
     gdt[num].base_middle = (base >> 16) & 0xFF;
@@ -24,26 +43,79 @@ static void gdt_set_gate(int num, uint32_t base, uint32_t limit, uint8_t access,
     gdt[num].access = access;
 }
 
-// Initialize GDT
-void gdt_init(void) {
-    gdt_pointer.limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
-    gdt_pointer.base = (uint32_t)&gdt;
+// Initialize the GDT of one CPU and load it
+void gdt_init_cpu(uint32_t index) {
+    struct cpu_tables* tables = &cpu_tables[index];
+    struct gdt_entry* gdt = tables->gdt;
+    struct cpu* cpu = &cpu_data[index];
+
+    cpu->self = cpu;
+    cpu->index = index;
+
+    tables->gdt_pointer.limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
+    tables->gdt_pointer.base = (uint32_t)gdt;
 
     // Null descriptor (required)
-    gdt_set_gate(0, 0, 0, 0, 0);
+    gdt_set_gate(gdt, 0, 0, 0, 0, 0);
 
     // Code segment descriptor
     // Base = 0x00000000, Limit = 0xFFFFFFFF
     // Access = 0x9A: Present, Ring 0, Executable, Readable
     // Granularity = 0xCF: 4KB granularity, 32-bit
-    gdt_set_gate(1, 0, 0xFFFFFFFF, 0x9A, 0xCF);
+    gdt_set_gate(gdt, 1, 0, 0xFFFFFFFF, 0x9A, 0xCF);
 
     // Data segment descriptor
     // Base = 0x00000000, Limit = 0xFFFFFFFF
     // Access = 0x92: Present, Ring 0, Writable
     // Granularity = 0xCF: 4KB granularity, 32-bit
-    gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF);
+    gdt_set_gate(gdt, 2, 0, 0xFFFFFFFF, 0x92, 0xCF);
+
+    // Task state segments
+    // Access = 0x89: Present, Ring 0, 32-bit available TSS; byte granularity
+    struct tss_entry* kernel_tss = &tables->kernel_tss;
+    memset(kernel_tss, 0, sizeof(*kernel_tss));
+    kernel_tss->ss0 = GDT_KERNEL_DATA;
+    kernel_tss->iomap_base = sizeof(struct tss_entry);
+    gdt_set_gate(gdt, 3, (uint32_t)kernel_tss, sizeof(*kernel_tss) - 1, 0x89, 0x00);
+
+    struct tss_entry* df_tss = &tables->double_fault_tss;
+    memset(df_tss, 0, sizeof(*df_tss));
+    df_tss->cr3 = read_cr3();
+    df_tss->eip = (uint32_t)double_fault_task;
+    df_tss->eflags = 0x2;  // Reserved bit, interrupts disabled
+    df_tss->esp = (uint32_t)(tables->double_fault_stack + DF_STACK_SIZE);
+    df_tss->cs = GDT_KERNEL_CODE;
+    df_tss->ds = GDT_KERNEL_DATA;
+    df_tss->es = GDT_KERNEL_DATA;
+    df_tss->fs = GDT_PERCPU;
+    df_tss->gs = GDT_KERNEL_DATA;
+    df_tss->ss = GDT_KERNEL_DATA;
+    df_tss->iomap_base = sizeof(struct tss_entry);
+    gdt_set_gate(gdt, 4, (uint32_t)df_tss, sizeof(*df_tss) - 1, 0x89, 0x00);
+
+    // Per-CPU data segment
+    // Access = 0x92: Present, Ring 0, Writable
+    // Granularity = 0x40: byte granularity, 32-bit
+    gdt_set_gate(gdt, 5, (uint32_t)cpu, sizeof(*cpu) - 1, 0x92, 0x40);
 
     // Load GDT
-    gdt_flush((uint32_t)&gdt_pointer);
+    gdt_flush((uint32_t)&tables->gdt_pointer);
+    asm volatile("mov %w0, %%fs" : : "r"(GDT_PERCPU) : "memory");
+
+    // Load task register (the CPU saves the interrupted state here on a task switch)
+    asm volatile("ltr %w0" : : "r"(GDT_KERNEL_TSS));
+}
+
+// Initialize the boot CPU's GDT
+void gdt_init(void) {
+    gdt_init_cpu(0);
+}
+
+void gdt_set_double_fault_cr3(uint32_t cr3) {
+    cpu_tables[this_cpu()->index].double_fault_tss.cr3 = cr3;
+}
+
+// Task state saved by the CPU when a double fault switches tasks
+const struct tss_entry* gdt_get_kernel_tss(void) {
+    return &cpu_tables[this_cpu()->index].kernel_tss;
 }
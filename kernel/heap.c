@@ -0,0 +1,348 @@
+#include "include/heap.h"
+#include "include/pmm.h"
+#include "include/string.h"
+#include "include/cpu.h"
+#include "include/spinlock.h"
+
+// Kernel heap built from slab caches
+//
+// Each cache hands out fixed-size objects carved from slabs of one or more
+// physically contiguous pages. The slab header occupies the first cache line
+// of the slab so objects that are a multiple of the line size stay aligned.
+// kmalloc rounds requests up to a power-of-two class with its own cache;
+// anything above the largest class is served directly by the page allocator.
+// A per-frame owner table maps any pointer back to its slab (or large
+// allocation) so kfree needs no size argument. Each cache has its own lock,
+// so CPUs allocating from different size classes do not contend.
+
+// Slab header, padded to one cache line
+struct slab {
+    struct slab* next;
+    struct slab* prev;
+    struct kmem_cache* cache;
+    void* free_list;          // Free objects, linked through their first word
+    uint32_t in_use;          // Allocated objects in this slab
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// Slab cache
+struct kmem_cache {
+    struct spinlock lock;
+    struct lock_class lock_class;   // Contention on this cache's lock, for lockstat
+    const char* name;
+    uint32_t object_size;
+    uint32_t slab_pages;
+    uint32_t objects_per_slab;
+    struct slab* partial;     // Slabs with at least one free object
+    struct slab* full;        // Slabs with no free objects
+    struct slab* empty;       // At most one completely free slab kept for reuse
+    uint32_t slabs;
+    uint32_t objects_in_use;
+    uint32_t alloc_count;
+    uint32_t free_count;
+    uint32_t hits;
+};
+
+// Owner table entries: slab pointer, or (pages << 1) | 1 for large allocations
+#define OWNER_LARGE             1u
+#define SLAB_MAX_PAGES          8
+#define SLAB_MIN_OBJECTS        8
+
+static struct kmem_cache caches[HEAP_MAX_CACHES];
+static uint32_t cache_count = 0;
+static struct kmem_cache* size_classes[HEAP_NUM_CLASSES];
+
+static uint32_t* page_owner = 0;     // One entry per physical frame
+static uint32_t page_owner_frames = 0;
+
+static struct heap_stats stats;
+static LOCK_CLASS(large_class, "heap-large");
+static struct spinlock large_lock = SPINLOCK_INIT(&large_class);   // Large allocation stats
+
+// Class names for kmalloc caches
+static const char* class_names[HEAP_NUM_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+};
+
+// Doubly-linked slab list helpers
+static void slab_list_push(struct slab** head, struct slab* slab) {
+    slab->prev = 0;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void slab_list_remove(struct slab** head, struct slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+// Record the owner of pages starting at physical address phys
+static void set_owner(uint32_t phys, uint32_t pages, uint32_t owner) {
+    uint32_t frame = phys >> PAGE_SHIFT;
+    for (uint32_t i = 0; i < pages && frame + i < page_owner_frames; i++) {
+        page_owner[frame + i] = owner;
+    }
+}
+
+// Set up a cache descriptor for objects of the given size
+static struct kmem_cache* cache_setup(const char* name, uint32_t size) {
+    if (cache_count >= HEAP_MAX_CACHES) {
+        return 0;
+    }
+
+    struct kmem_cache* cache = &caches[cache_count++];
+    memset(cache, 0, sizeof(*cache));
+    cache->name = name;
+    cache->object_size = size;
+    cache->lock_class.name = name;
+    spin_lock_init(&cache->lock, &cache->lock_class);
+
+    // Grow slabs until the per-slab overhead is amortised over enough objects
+    cache->slab_pages = 1;
+    for (;;) {
+        uint32_t usable = cache->slab_pages * PAGE_SIZE - sizeof(struct slab);
+        cache->objects_per_slab = usable / size;
+        if (cache->objects_per_slab >= SLAB_MIN_OBJECTS || cache->slab_pages >= SLAB_MAX_PAGES) {
+            break;
+        }
+        cache->slab_pages *= 2;
+    }
+
+    return cache;
+}
+
+// Allocate and format a new slab
+static struct slab* slab_create(struct kmem_cache* cache) {
+    uint32_t phys = pmm_alloc_frames(cache->slab_pages);
+    if (phys == 0) {
+        return 0;
+    }
+
+    struct slab* slab = (struct slab*)PHYS_TO_VIRT(phys);
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free_list = 0;
+
+    // Thread the free list through the objects, lowest address first
+    uint8_t* base = (uint8_t*)(slab + 1);
+    for (uint32_t i = cache->objects_per_slab; i > 0; i--) {
+        void** obj = (void**)(base + (i - 1) * cache->object_size);
+        *obj = slab->free_list;
+        slab->free_list = obj;
+    }
+
+    set_owner(phys, cache->slab_pages, (uint32_t)slab);
+    cache->slabs++;
+    return slab;
+}
+
+static void slab_destroy(struct kmem_cache* cache, struct slab* slab) {
+    set_owner(VIRT_TO_PHYS(slab), cache->slab_pages, 0);
+    pmm_free_frames(VIRT_TO_PHYS(slab), cache->slab_pages);
+    cache->slabs--;
+}
+
+// Initialize heap
+void heap_init(void) {
+    struct pmm_stats pmm;
+    pmm_get_stats(&pmm);
+
+    memset(&stats, 0, sizeof(stats));
+
+    // Owner table covering every usable frame
+    uint32_t table_pages = (pmm.end_frame * sizeof(uint32_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t table = pmm_alloc_frames(table_pages);
+    if (table == 0) {
+        return;
+    }
+    page_owner = (uint32_t*)PHYS_TO_VIRT(table);
+    page_owner_frames = pmm.end_frame;
+    memset(page_owner, 0, table_pages * PAGE_SIZE);
+
+    // Power-of-two size classes
+    for (uint32_t i = 0; i < HEAP_NUM_CLASSES; i++) {
+        size_classes[i] = cache_setup(class_names[i], 1u << (HEAP_MIN_SHIFT + i));
+    }
+}
+
+// Create a named object cache
+struct kmem_cache* kmem_cache_create(const char* name, size_t size) {
+    if (size == 0 || size > PAGE_SIZE) {
+        return 0;
+    }
+
+    // Round up to whole cache lines
+    uint32_t rounded = (size + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+    return cache_setup(name, rounded);
+}
+
+// Allocate one object from a cache
+void* kmem_cache_alloc(struct kmem_cache* cache) {
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    struct slab* slab = cache->partial;
+
+    if (slab) {
+        cache->hits++;
+    } else if (cache->empty) {
+        // Reuse the cached empty slab without touching the page allocator
+        slab = cache->empty;
+        cache->empty = 0;
+        slab_list_push(&cache->partial, slab);
+        cache->hits++;
+    } else {
+        slab = slab_create(cache);
+        if (slab == 0) {
+            stats.failed_count++;
+            spin_unlock_irqrestore(&cache->lock, flags);
+            return 0;
+        }
+        slab_list_push(&cache->partial, slab);
+    }
+
+    void** obj = (void**)slab->free_list;
+    slab->free_list = *obj;
+    slab->in_use++;
+
+    if (slab->free_list == 0) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+    }
+
+    cache->objects_in_use++;
+    cache->alloc_count++;
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return obj;
+}
+
+// Return one object to its cache
+void kmem_cache_free(struct kmem_cache* cache, void* obj) {
+    struct slab* slab = (struct slab*)page_owner[VIRT_TO_PHYS(obj) >> PAGE_SHIFT];
+    if (slab == 0 || slab->cache != cache) {
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+
+    // A full slab becomes partial again
+    if (slab->free_list == 0) {
+        slab_list_remove(&cache->full, slab);
+        slab_list_push(&cache->partial, slab);
+    }
+
+    *(void**)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->in_use--;
+    cache->objects_in_use--;
+    cache->free_count++;
+
+    // Keep one empty slab around, give any further ones back
+    if (slab->in_use == 0) {
+        slab_list_remove(&cache->partial, slab);
+        if (cache->empty == 0) {
+            cache->empty = slab;
+        } else {
+            slab_destroy(cache, slab);
+        }
+    }
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+// Allocate size bytes
+void* kmalloc(size_t size) {
+    if (size == 0 || page_owner == 0) {
+        return 0;
+    }
+
+    if (size <= (1u << HEAP_MAX_SHIFT)) {
+        // Smallest class that fits: ceil(log2(size)), at least the minimum class
+        uint32_t shift = HEAP_MIN_SHIFT;
+        if (size > (1u << HEAP_MIN_SHIFT)) {
+            shift = 32 - __builtin_clz(size - 1);
+        }
+        return kmem_cache_alloc(size_classes[shift - HEAP_MIN_SHIFT]);
+    }
+
+    // Large allocation straight from the page allocator
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t phys = pmm_alloc_frames(pages);
+    if (phys == 0) {
+        stats.failed_count++;
+        return 0;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&large_lock);
+    set_owner(phys, pages, (pages << 1) | OWNER_LARGE);
+    stats.large_allocs++;
+    stats.large_pages += pages;
+    spin_unlock_irqrestore(&large_lock, flags);
+    return (void*)PHYS_TO_VIRT(phys);
+}
+
+// Allocate size bytes, zero-filled
+void* kzalloc(size_t size) {
+    void* ptr = kmalloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+// Free memory returned by kmalloc/kzalloc
+void kfree(void* ptr) {
+    if (ptr == 0 || page_owner == 0) {
+        return;
+    }
+
+    uint32_t phys = VIRT_TO_PHYS(ptr);
+    uint32_t frame = phys >> PAGE_SHIFT;
+    if (frame >= page_owner_frames) {
+        return;
+    }
+
+    uint32_t owner = page_owner[frame];
+    if (owner & OWNER_LARGE) {
+        uint32_t pages = owner >> 1;
+        uint32_t flags = spin_lock_irqsave(&large_lock);
+        set_owner(phys, pages, 0);
+        stats.large_allocs--;
+        stats.large_pages -= pages;
+        spin_unlock_irqrestore(&large_lock, flags);
+        pmm_free_frames(phys, pages);
+    } else if (owner != 0) {
+        struct slab* slab = (struct slab*)owner;
+        kmem_cache_free(slab->cache, ptr);
+    }
+}
+
+// Whole-heap statistics
+void heap_get_stats(struct heap_stats* out) {
+    memcpy(out, &stats, sizeof(stats));
+    out->cache_count = cache_count;
+}
+
+// Statistics for cache number index, returns 0 when index is out of range
+int heap_get_cache_stats(uint32_t index, struct kmem_cache_stats* out) {
+    if (index >= cache_count) {
+        return 0;
+    }
+
+    const struct kmem_cache* cache = &caches[index];
+    out->name = cache->name;
+    out->object_size = cache->object_size;
+    out->objects_in_use = cache->objects_in_use;
+    out->slabs = cache->slabs;
+    out->slab_pages = cache->slab_pages;
+    out->alloc_count = cache->alloc_count;
+    out->free_count = cache->free_count;
+    out->hits = cache->hits;
+    return 1;
+}
@@ -1,12 +1,23 @@
 #include "include/idt.h"
 #include "include/port_io.h"
-#include "include/keyboard.h"
 #include "include/timer.h"
 #include "include/print.h"
+#include "include/kprintf.h"
+#include "include/klog.h"
 #include "include/string.h"
+#include "include/cpu.h"
+#include "include/gdt.h"
+#include "include/memlayout.h"
+#include "include/apic.h"
+#include "include/percpu.h"
+#include "include/spinlock.h"
+#include "include/softirq.h"
 
 // IDT with 256 entries
 #define IDT_ENTRIES 256
+
+// Log records shown under the panic message
+#define PANIC_LOG_RECORDS 8
 struct idt_entry idt[IDT_ENTRIES];
 struct idt_ptr idt_pointer;
 
@@ -101,6 +112,56 @@ extern void irq13(void);
 extern void irq14(void);
 extern void irq15(void);
 
+// IOAPIC-only IRQs (GSIs 16-23, vectors 48-55) and the LAPIC spurious vector
+extern void irq16(void);
+extern void irq17(void);
+extern void irq18(void);
+extern void irq19(void);
+extern void irq20(void);
+extern void irq21(void);
+extern void irq22(void);
+extern void irq23(void);
+extern void irq240(void);
+extern void irq241(void);
+extern void irq_spurious(void);
+
+// Cached 8259 masks, so masking is a single port write
+static uint8_t pic_masks[2] = { 0xFF, 0xFF };
+
+// IRQ handler table
+//
+// Each vector from IRQ_OFFSET up has a chain of handlers, so dispatch is one
+// indexed load and a call per handler. Actions come from a static pool and
+// are only ever appended, fully built before they are linked in, so CPUs
+// taking interrupts walk the chains without a lock. Counts and cycles sit in
+// a separate table for each CPU, indexed by vector, so the interrupts every
+// CPU takes (the LAPIC timer) update lines no other CPU writes.
+struct irq_action {
+    int (*handler)(void* ctx);
+    void* ctx;
+    const char* name;
+    struct irq_action* next;
+};
+
+struct irq_cpu_stats {
+    uint32_t count;
+    uint32_t unhandled;
+    uint64_t cycles;
+};
+
+struct irq_desc {
+    struct irq_action* volatile actions;
+    uint32_t handlers;
+};
+
+static struct irq_desc irq_descs[IRQ_VECTORS];
+// Rows are a whole number of cache lines, so aligning the table aligns each
+static struct irq_cpu_stats irq_cpu_stats[MAX_CPUS][IRQ_VECTORS] __attribute__((aligned(64)));
+static struct irq_action irq_actions[IRQ_MAX_ACTIONS];
+static uint32_t irq_action_count = 0;
+static LOCK_CLASS(irq_class, "irq-register");
+static struct spinlock irq_lock = SPINLOCK_INIT(&irq_class);
+
 // Set an IDT gate
 void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags) {
     idt[num].base_lo = base & 0xFFFF;
@@ -129,7 +190,7 @@ void idt_init(void) {
     idt_set_gate(5, (uint32_t)isr5, 0x08, IDT_FLAGS_KERNEL_INT);
     idt_set_gate(6, (uint32_t)isr6, 0x08, IDT_FLAGS_KERNEL_INT);
     idt_set_gate(7, (uint32_t)isr7, 0x08, IDT_FLAGS_KERNEL_INT);
-    idt_set_gate(8, (uint32_t)isr8, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(8, 0, GDT_DF_TSS, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_TASK);
     idt_set_gate(9, (uint32_t)isr9, 0x08, IDT_FLAGS_KERNEL_INT);
     idt_set_gate(10, (uint32_t)isr10, 0x08, IDT_FLAGS_KERNEL_INT);
     idt_set_gate(11, (uint32_t)isr11, 0x08, IDT_FLAGS_KERNEL_INT);
@@ -171,6 +232,17 @@ void idt_init(void) {
     idt_set_gate(45, (uint32_t)irq13, 0x08, IDT_FLAGS_KERNEL_INT);
     idt_set_gate(46, (uint32_t)irq14, 0x08, IDT_FLAGS_KERNEL_INT);
     idt_set_gate(47, (uint32_t)irq15, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(48, (uint32_t)irq16, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(49, (uint32_t)irq17, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(50, (uint32_t)irq18, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(51, (uint32_t)irq19, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(52, (uint32_t)irq20, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(53, (uint32_t)irq21, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(54, (uint32_t)irq22, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(55, (uint32_t)irq23, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(LAPIC_TIMER_VECTOR, (uint32_t)irq240, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(IPI_RESCHED_VECTOR, (uint32_t)irq241, 0x08, IDT_FLAGS_KERNEL_INT);
+    idt_set_gate(APIC_SPURIOUS_VECTOR, (uint32_t)irq_spurious, 0x08, IDT_FLAGS_KERNEL_INT);
 
     // Load IDT
     idt_flush((uint32_t)&idt_pointer);
@@ -182,69 +254,68 @@ void idt_init(void) {
     asm volatile("sti");
 }
 
+// Load the IDT built by idt_init
+void idt_load(void) {
+    idt_flush((uint32_t)&idt_pointer);
+}
+
 // Common ISR handler (called from assembly) - handles CPU exceptions
-void isr_handler(uint32_t int_no, uint32_t err_code) {
+void isr_handler(struct registers* regs) {
+    uint32_t int_no = regs->int_no;
+    uint32_t err_code = regs->err_code;
+
     // Display kernel panic in white on red background
+    terminal_panic();
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_RED));
     terminal_writestring("\n\n");
     terminal_writestring("================== KERNEL PANIC ==================\n");
 
-    // Display exception name
-    terminal_writestring("Exception: ");
-    if (int_no < 32) {
-        terminal_writestring(exception_messages[int_no]);
-    } else {
-        terminal_writestring("Unknown");
-    }
-    terminal_writestring("\n");
-
-    // Display vector number in decimal and hex
-    terminal_writestring("Vector: ");
-    char buffer[16];
-    itoa(int_no, buffer, 10);
-    terminal_writestring(buffer);
-    terminal_writestring(" (0x");
-    itoa(int_no, buffer, 16);
-    terminal_writestring(buffer);
-    terminal_writestring(")\n");
-
-    // Display error code
-    terminal_writestring("Error Code: 0x");
-    itoa(err_code, buffer, 16);
-    terminal_writestring(buffer);
-    terminal_writestring("\n");
+    // Exception name, vector, error code and faulting instruction
+    kprintf("Exception: %s\n", int_no < 32 ? exception_messages[int_no] : "Unknown");
+    kprintf("Vector: %u (0x%x)\n", int_no, int_no);
+    kprintf("Error Code: 0x%x\n", err_code);
+    kprintf("EIP: 0x%08x\n", regs->eip);
 
     // Exception-specific details
     if (int_no == 14) {  // Page fault
         // Read CR2 register containing faulting virtual address
-        uint32_t faulting_address;
-        asm volatile("mov %%cr2, %0" : "=r"(faulting_address));
+        uint32_t faulting_address = read_cr2();
 
-        terminal_writestring("\nPage Fault Details:\n");
-        terminal_writestring("  Faulting Address: 0x");
-        itoa(faulting_address, buffer, 16);
-        terminal_writestring(buffer);
-        terminal_writestring("\n");
+        kprintf("\nPage Fault Details:\n  Faulting Address: 0x%08x\n", faulting_address);
 
         terminal_writestring("  Caused by: ");
-        if (!(err_code & 0x1)) {
+        if (err_code & 0x8) {
+            terminal_writestring("Reserved bit set");
+        } else if (!(err_code & 0x1)) {
             terminal_writestring("Page not present");
         } else if (err_code & 0x2) {
             terminal_writestring("Write to read-only page");
         } else if (err_code & 0x4) {
             terminal_writestring("User mode access to kernel page");
-        } else if (err_code & 0x8) {
-            terminal_writestring("Reserved bit set");
         } else {
-            terminal_writestring("Unknown reason");
+            terminal_writestring("Protection violation");
         }
         terminal_writestring("\n");
+
+        terminal_writestring("  Access: ");
+        if (err_code & 0x10) {
+            terminal_writestring("Instruction fetch");
+        } else if (err_code & 0x2) {
+            terminal_writestring("Write");
+        } else {
+            terminal_writestring("Read");
+        }
+        terminal_writestring((err_code & 0x4) ? " (user mode)\n" : " (kernel mode)\n");
+    } else if (int_no == 8) {  // Double fault (entered through the task gate)
+        kprintf("\nDouble Fault Details:\n  ESP: 0x%08x\n", regs->esp);
+
+        // ESP at or just below the bottom of the boot stack means it ran into the guard
+        uint32_t guard = (uint32_t)boot_stack_guard;
+        if (regs->esp >= guard - 64 && regs->esp < (uint32_t)boot_stack_bottom + 64) {
+            terminal_writestring("  Kernel stack overflow (guard page hit)\n");
+        }
     } else if (int_no == 13) {  // General Protection Fault
-        terminal_writestring("\nGeneral Protection Fault Details:\n");
-        terminal_writestring("  Segment Selector: 0x");
-        itoa(err_code & 0xFFF8, buffer, 16);
-        terminal_writestring(buffer);
-        terminal_writestring("\n");
+        kprintf("\nGeneral Protection Fault Details:\n  Segment Selector: 0x%x\n", err_code & 0xFFF8);
 
         terminal_writestring("  Table: ");
         if (err_code & 0x2) {
@@ -270,6 +341,10 @@ void isr_handler(uint32_t int_no, uint32_t err_code) {
         terminal_writestring("  - Wrong CPU architecture\n");
     }
 
+    // The log leading up to it
+    terminal_writestring("\nRecent log:\n");
+    klog_dump(PANIC_LOG_RECORDS, KLOG_DEBUG);
+
     // Display halt message
     terminal_writestring("\n");
     terminal_writestring("==================================================\n");
@@ -284,17 +359,114 @@ void isr_handler(uint32_t int_no, uint32_t err_code) {
     }
 }
 
+// Double fault handler, running in its own task
+void double_fault_handler(uint32_t err_code) {
+    // The interrupted state was saved into the kernel TSS by the task switch
+    const struct tss_entry* tss = gdt_get_kernel_tss();
+    struct registers regs;
+
+    memset(&regs, 0, sizeof(regs));
+    regs.int_no = 8;
+    regs.err_code = err_code;
+    regs.eip = tss->eip;
+    regs.cs = tss->cs;
+    regs.eflags = tss->eflags;
+    regs.esp = tss->esp;
+    regs.ds = tss->ds;
+
+    isr_handler(&regs);
+}
+
+int irq_register_vector(uint8_t vector, const char* name, int (*handler)(void* ctx), void* ctx) {
+    if (vector < IRQ_OFFSET) {
+        return 0;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&irq_lock);
+    if (irq_action_count >= IRQ_MAX_ACTIONS) {
+        spin_unlock_irqrestore(&irq_lock, flags);
+        return 0;
+    }
+
+    struct irq_action* action = &irq_actions[irq_action_count++];
+    action->handler = handler;
+    action->ctx = ctx;
+    action->name = name;
+    action->next = 0;
+
+    // Publish at the tail, after the action is complete
+    struct irq_desc* desc = &irq_descs[vector - IRQ_OFFSET];
+    struct irq_action* volatile* link = &desc->actions;
+    while (*link) {
+        link = &(*link)->next;
+    }
+    barrier();
+    *link = action;
+    desc->handlers++;
+
+    spin_unlock_irqrestore(&irq_lock, flags);
+    return 1;
+}
+
+int irq_register(uint8_t irq, const char* name, int (*handler)(void* ctx), void* ctx) {
+    return irq_register_vector(IRQ_OFFSET + irq, name, handler, ctx);
+}
+
+int irq_get_stats(uint8_t vector, struct irq_stats* out) {
+    if (vector < IRQ_OFFSET) {
+        return 0;
+    }
+
+    const struct irq_desc* desc = &irq_descs[vector - IRQ_OFFSET];
+    out->name = desc->actions ? desc->actions->name : 0;
+    out->handlers = desc->handlers;
+    out->count = 0;
+    out->unhandled = 0;
+    out->cycles = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        const struct irq_cpu_stats* stats = &irq_cpu_stats[cpu][vector - IRQ_OFFSET];
+        out->count += stats->count;
+        out->unhandled += stats->unhandled;
+        out->cycles += stats->cycles;
+    }
+    return out->handlers != 0 || out->count != 0;
+}
+
 // Common IRQ handler (called from assembly)
-void irq_handler(uint32_t irq_no) {
-    // Handle specific IRQs
-    if (irq_no == 32) {  // IRQ0 - Timer
-        timer_handler();
-    } else if (irq_no == 33) {  // IRQ1 - Keyboard
-        keyboard_handler();
+void irq_handler(struct registers* regs) {
+    uint64_t entry_tsc = rdtsc();
+    uint32_t irq_no = regs->int_no;
+    uint32_t cpu = this_cpu_read(index);
+
+    // Catch up on ticks skipped by tickless idle before anyone reads the time
+    // (only the boot CPU runs the PIT tick)
+    if (irq_no != IRQ_OFFSET && cpu == 0) {
+        timer_irq_enter();
+    }
+
+    // Run every handler on the vector. They find the interrupted state in
+    // irq_regs; handlers run with interrupts off, so it cannot be nested.
+    uint64_t start = rdtsc();
+    struct irq_desc* desc = &irq_descs[irq_no - IRQ_OFFSET];
+    this_cpu()->irq_regs = regs;
+    int handled = IRQ_NONE;
+    for (struct irq_action* action = desc->actions; action; action = action->next) {
+        handled |= action->handler(action->ctx);
     }
+    this_cpu()->irq_regs = 0;
 
-    // Send EOI to PIC
-    pic_send_eoi(irq_no - IRQ_OFFSET);
+    struct irq_cpu_stats* stats = &irq_cpu_stats[cpu][irq_no - IRQ_OFFSET];
+    stats->count++;
+    stats->cycles += rdtsc() - start;
+    if (handled == IRQ_NONE) {
+        stats->unhandled++;
+    }
+
+    // Acknowledge at the interrupt controller
+    irq_eoi(irq_no - IRQ_OFFSET);
+
+    // Deferred work with interrupts enabled, then maybe switch threads
+    irq_exit(entry_tsc);
 }
 
 // Initialize PIC and remap IRQs
@@ -332,8 +504,18 @@ void pic_init(void) {
     outb(PIC2_DATA, mask2);
 
     // Mask all IRQs except IRQ2 (cascade)
-    outb(PIC1_DATA, 0xFB);  // 11111011 - all masked except IRQ2
-    outb(PIC2_DATA, 0xFF);  // 11111111 - all masked
+    pic_masks[0] = 0xFB;  // 11111011 - all masked except IRQ2
+    pic_masks[1] = 0xFF;  // 11111111 - all masked
+    outb(PIC1_DATA, pic_masks[0]);
+    outb(PIC2_DATA, pic_masks[1]);
+}
+
+// Mask every line of both PICs (interrupts are delivered by the IOAPIC)
+void pic_disable(void) {
+    pic_masks[0] = 0xFF;
+    pic_masks[1] = 0xFF;
+    outb(PIC1_DATA, pic_masks[0]);
+    outb(PIC2_DATA, pic_masks[1]);
 }
 
 // Send End of Interrupt (EOI) to PIC
@@ -348,30 +530,38 @@ void pic_send_eoi(uint8_t irq) {
 
 // Mask (disable) an IRQ
 void pic_set_mask(uint8_t irq) {
-    uint16_t port;
-    uint8_t value;
-
-    if (irq < 8) {
-        port = PIC1_DATA;
-    } else {
-        port = PIC2_DATA;
-        irq -= 8;
-    }
-    value = inb(port) | (1 << irq);
-    outb(port, value);
+    uint32_t chip = irq >= 8;
+    pic_masks[chip] |= 1 << (irq & 7);
+    outb(chip ? PIC2_DATA : PIC1_DATA, pic_masks[chip]);
 }
 
 // Unmask (enable) an IRQ
 void pic_clear_mask(uint8_t irq) {
-    uint16_t port;
-    uint8_t value;
+    uint32_t chip = irq >= 8;
+    pic_masks[chip] &= ~(1 << (irq & 7));
+    outb(chip ? PIC2_DATA : PIC1_DATA, pic_masks[chip]);
+}
+
+void irq_mask(uint8_t irq) {
+    if (apic_enabled()) {
+        ioapic_set_mask(irq, 1);
+    } else if (irq < 16) {
+        pic_set_mask(irq);
+    }
+}
+
+void irq_unmask(uint8_t irq) {
+    if (apic_enabled()) {
+        ioapic_set_mask(irq, 0);
+    } else if (irq < 16) {
+        pic_clear_mask(irq);
+    }
+}
 
-    if (irq < 8) {
-        port = PIC1_DATA;
+void irq_eoi(uint8_t irq) {
+    if (apic_enabled()) {
+        lapic_eoi();
     } else {
-        port = PIC2_DATA;
-        irq -= 8;
+        pic_send_eoi(irq);
     }
-    value = inb(port) & ~(1 << irq);
-    outb(port, value);
 }
@@ -0,0 +1,70 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+#include "percpu.h"
+
+// Limits on what we record from the MADT (and MAX_CPUS)
+#define ACPI_MAX_IOAPICS    4
+#define ACPI_ISA_IRQS       16
+
+// Common header of every ACPI system description table
+struct acpi_header {
+    char signature[4];
+    uint32_t length;          // Whole table including this header
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+// Root system description pointer (ACPI 1.0 part)
+struct acpi_rsdp {
+    char signature[8];        // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+} __attribute__((packed));
+
+// MADT entry types
+#define MADT_LOCAL_APIC         0
+#define MADT_IO_APIC            1
+#define MADT_INT_OVERRIDE       2
+#define MADT_LAPIC_ADDR         5
+
+#define MADT_LAPIC_ENABLED      0x1
+
+// Interrupt source override polarity and trigger flags
+#define MADT_POLARITY_MASK      0x3
+#define MADT_POLARITY_LOW       0x3
+#define MADT_TRIGGER_MASK       0xC
+#define MADT_TRIGGER_LEVEL      0xC
+
+// Interrupt topology found in the MADT
+struct acpi_ioapic {
+    uint8_t id;
+    uint32_t phys_addr;
+    uint32_t gsi_base;        // First global system interrupt it handles
+};
+
+struct acpi_madt_info {
+    uint32_t lapic_phys;
+    uint32_t cpu_count;
+    uint8_t cpu_apic_ids[MAX_CPUS];
+    uint32_t ioapic_count;
+    struct acpi_ioapic ioapics[ACPI_MAX_IOAPICS];
+    uint32_t isa_gsi[ACPI_ISA_IRQS];    // ISA IRQ to GSI (identity unless overridden)
+    uint16_t isa_flags[ACPI_ISA_IRQS];  // Override polarity/trigger flags
+};
+
+// Find and parse the MADT, returns 0 if ACPI or the MADT is missing
+int acpi_init(void);
+
+// Parsed MADT (valid after a successful acpi_init)
+const struct acpi_madt_info* acpi_get_madt(void);
+
+#endif // ACPI_H
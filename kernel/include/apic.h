@@ -0,0 +1,98 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+
+// Local APIC register offsets
+#define LAPIC_ID            0x020
+#define LAPIC_VERSION       0x030
+#define LAPIC_TPR           0x080   // Task priority
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0   // Spurious interrupt vector
+#define LAPIC_ESR           0x280   // Error status
+#define LAPIC_ICR_LOW       0x300   // Interrupt command
+#define LAPIC_ICR_HIGH      0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_LVT_ERROR     0x370
+#define LAPIC_TIMER_INIT    0x380
+#define LAPIC_TIMER_COUNT   0x390
+#define LAPIC_TIMER_DIV     0x3E0
+
+// Local APIC register bits
+#define LAPIC_SVR_ENABLE    0x100
+#define LAPIC_ICR_INIT      0x500   // Delivery mode INIT
+#define LAPIC_ICR_STARTUP   0x600   // Delivery mode STARTUP (vector = page number)
+#define LAPIC_ICR_PENDING   0x1000  // Delivery status: send pending
+#define LAPIC_ICR_ASSERT    0x4000  // Level assert
+#define LAPIC_LVT_MASKED    0x10000
+#define LAPIC_LVT_NMI       0x400   // Delivery mode NMI
+#define LAPIC_LVT_PERIODIC  0x20000 // Timer mode periodic
+#define LAPIC_TIMER_DIV_16  0x3
+
+// I/O APIC registers (indirect through IOREGSEL/IOWIN)
+#define IOAPIC_REGSEL       0x00
+#define IOAPIC_WINDOW       0x10
+#define IOAPIC_REG_VERSION  0x01
+#define IOAPIC_REG_REDIR    0x10    // Redirection entry n at 0x10 + 2n
+
+// Redirection entry bits
+#define IOAPIC_POLARITY_LOW 0x2000
+#define IOAPIC_TRIGGER_LEVEL 0x8000
+#define IOAPIC_MASKED       0x10000
+
+// IRQ numbering: ISA IRQs 0-15 (as remapped by MADT overrides), then GSIs
+// 16-23 (PCI interrupt lines); IRQ n arrives on vector IRQ_OFFSET + n
+#define APIC_IRQ_COUNT      24
+
+// Vectors of interrupts raised by the LAPICs themselves
+#define LAPIC_TIMER_VECTOR  0xF0    // Scheduler tick of application processors
+#define IPI_RESCHED_VECTOR  0xF1    // Ask another CPU to reschedule
+#define APIC_SPURIOUS_VECTOR 0xFF   // Spurious interrupts (low nibble must be all ones)
+
+// LAPIC timer calibration period against the TSC (microseconds)
+#define LAPIC_CALIBRATE_US  10000
+
+// Switch interrupt delivery from the 8259 to the LAPIC and IOAPIC when the
+// MADT describes them, returns 0 (PIC stays in use) otherwise
+int apic_init(void);
+
+// Whether the LAPIC/IOAPIC path is in use
+int apic_enabled(void);
+
+// Local APIC access for the current CPU
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t value);
+uint32_t lapic_get_id(void);
+void lapic_eoi(void);
+
+// Enable the calling CPU's LAPIC (the boot CPU does this in apic_init)
+void lapic_init_cpu(void);
+
+// Send an inter-processor interrupt and wait until it has been accepted
+void lapic_send_ipi(uint32_t apic_id, uint32_t command);
+
+// Measure the LAPIC timer rate for a periodic tick of hz (boot CPU)
+void lapic_timer_calibrate(uint32_t hz);
+
+// Start the calling CPU's periodic LAPIC timer tick, once calibrated
+void lapic_timer_start(void);
+
+// Run the calling CPU's LAPIC timer at multiplier times the tick rate, or
+// stop it with 0. Returns 0 when there is no calibrated LAPIC timer.
+int lapic_timer_set_rate(uint32_t multiplier);
+
+// LAPIC timer counts in one tick, 0 until calibrated
+uint32_t lapic_timer_tick_count(void);
+
+// Arm the calling CPU's LAPIC timer to interrupt once after count counts
+void lapic_timer_oneshot(uint32_t count);
+
+// Counts left before the calling CPU's one-shot fires (0 once it has)
+uint32_t lapic_timer_remaining(void);
+
+// Mask or unmask an IRQ at its IOAPIC pin
+void ioapic_set_mask(uint32_t irq, int masked);
+
+#endif // APIC_H
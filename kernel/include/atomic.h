@@ -0,0 +1,61 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <stdint.h>
+
+// Atomic operations on aligned 32-bit words. Every locked instruction is a
+// full barrier on x86, so these also order the surrounding accesses.
+
+// Keep the compiler from moving memory accesses across this point
+static inline void barrier(void) {
+    asm volatile("" : : : "memory");
+}
+
+// Ordering for lock-free publication. x86 never reorders stores with older
+// stores or loads with older loads, so these only have to stop the compiler.
+static inline void smp_wmb(void) {
+    barrier();
+}
+
+static inline void smp_rmb(void) {
+    barrier();
+}
+
+// Earlier loads and stores before a later store that hands them off
+// (release). x86 does not reorder a store with older loads either.
+static inline void smp_release(void) {
+    barrier();
+}
+
+// Store value, return the previous contents
+static inline uint32_t atomic_xchg(volatile uint32_t* ptr, uint32_t value) {
+    asm volatile("xchgl %0, %1" : "+r"(value), "+m"(*ptr) : : "memory");
+    return value;
+}
+
+// Store value if *ptr == expected, return what *ptr held before
+static inline uint32_t atomic_cmpxchg(volatile uint32_t* ptr, uint32_t expected, uint32_t value) {
+    uint32_t prev;
+    asm volatile("lock cmpxchgl %2, %1"
+                 : "=a"(prev), "+m"(*ptr)
+                 : "r"(value), "0"(expected)
+                 : "memory");
+    return prev;
+}
+
+// Add delta, return the new value
+static inline uint32_t atomic_add_return(volatile uint32_t* ptr, uint32_t delta) {
+    uint32_t old = delta;
+    asm volatile("lock xaddl %0, %1" : "+r"(old), "+m"(*ptr) : : "memory");
+    return old + delta;
+}
+
+static inline void atomic_or(volatile uint32_t* ptr, uint32_t bits) {
+    asm volatile("lock orl %1, %0" : "+m"(*ptr) : "r"(bits) : "memory");
+}
+
+static inline void atomic_and(volatile uint32_t* ptr, uint32_t bits) {
+    asm volatile("lock andl %1, %0" : "+m"(*ptr) : "r"(bits) : "memory");
+}
+
+#endif // ATOMIC_H
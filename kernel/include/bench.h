@@ -0,0 +1,44 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+// Result of one micro-benchmark run
+struct bench_result {
+    uint32_t ops;             // Operations measured
+    uint64_t cycles;          // Total TSC cycles
+    uint32_t cycles_per_op;   // Average cycles per operation
+    uint32_t ns_per_op;       // Average nanoseconds per operation
+};
+
+// Ping-pong between two threads with thread_yield, returns 0 on failure
+int bench_switch(uint32_t iterations, struct bench_result* out);
+
+// Run threads independent CPU-bound workers of work iterations each, timed
+// until the last one finishes (out->cycles is the wall time), returns 0 on failure
+int bench_parallel(uint32_t threads, uint32_t work, struct bench_result* out);
+
+// Arm then cancel count timers with spread-out delays, returns 0 on failure
+int bench_timers(uint32_t count, struct bench_result* arm, struct bench_result* cancel);
+
+// Bytes moved per size in bench_mem
+#define BENCH_MEM_TOTAL (16 * 1024 * 1024)
+
+// memcpy and memset over size-byte buffers (ops counts bytes), returns 0 when
+// the buffers cannot be allocated
+int bench_mem(uint32_t size, struct bench_result* copy, struct bench_result* set);
+
+enum bench_string_op {
+    BENCH_STRLEN,
+    BENCH_STRCMP,
+    BENCH_STRCPY,
+};
+
+// Characters scanned per measurement in bench_string
+#define BENCH_STRING_TOTAL (4 * 1024 * 1024)
+
+// A string function on len-character strings, the word-at-a-time version
+// against a plain byte loop (ops counts calls), returns 0 on out of memory
+int bench_string(enum bench_string_op op, uint32_t len, struct bench_result* fast, struct bench_result* bytes);
+
+#endif // BENCH_H
@@ -0,0 +1,128 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+// CPUID leaf 1 EDX feature bits
+#define CPUID_FEAT_EDX_PSE   (1 << 3)    // 4 MiB pages
+#define CPUID_FEAT_EDX_TSC   (1 << 4)    // Time-stamp counter
+#define CPUID_FEAT_EDX_MSR   (1 << 5)    // RDMSR/WRMSR
+#define CPUID_FEAT_EDX_APIC  (1 << 9)    // On-chip local APIC
+#define CPUID_FEAT_EDX_PGE   (1 << 13)   // Global pages
+#define CPUID_FEAT_EDX_FXSR  (1 << 24)   // FXSAVE/FXRSTOR
+#define CPUID_FEAT_EDX_SSE2  (1 << 26)   // SSE2
+
+// CPUID leaf 0x80000007 EDX bits
+#define CPUID_APM_EDX_INVARIANT_TSC (1 << 8)  // TSC rate independent of P/C-states
+
+// EFLAGS bits
+#define EFLAGS_IF            (1u << 9)   // Interrupts enabled
+
+// Model-specific registers
+#define MSR_APIC_BASE        0x1B
+#define MSR_APIC_BASE_ENABLE (1u << 11)  // Local APIC global enable
+
+// Control register bits
+#define CR0_MP               (1u << 1)   // WAIT/FWAIT honour TS
+#define CR0_EM               (1u << 2)   // No FPU: trap FPU and SSE instructions
+#define CR0_WP               (1u << 16)  // Honour read-only pages in ring 0
+#define CR0_PG               (1u << 31)  // Paging enable
+#define CR4_PSE              (1u << 4)   // Page size extensions
+#define CR4_PGE              (1u << 7)   // Page global enable
+#define CR4_OSFXSR           (1u << 9)   // FXSAVE/FXRSTOR and SSE enabled
+#define CR4_OSXMMEXCPT       (1u << 10)  // SIMD exceptions raise #XM
+
+// Execute CPUID for the given leaf
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile("cpuid"
+                 : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                 : "a"(leaf), "c"(0));
+}
+
+// Control register access
+static inline uint32_t read_cr0(void) {
+    uint32_t value;
+    asm volatile("mov %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr0(uint32_t value) {
+    asm volatile("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline uint32_t read_cr2(void) {
+    uint32_t value;
+    asm volatile("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static inline uint32_t read_cr3(void) {
+    uint32_t value;
+    asm volatile("mov %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr3(uint32_t value) {
+    asm volatile("mov %0, %%cr3" : : "r"(value) : "memory");
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t value;
+    asm volatile("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(uint32_t value) {
+    asm volatile("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+// Model-specific register access
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t low, high;
+    asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+// Invalidate the TLB entry for one virtual address
+static inline void invlpg(uint32_t addr) {
+    asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+// Index of the lowest set bit (value must be non-zero)
+static inline uint32_t bsf(uint32_t value) {
+    uint32_t index;
+    asm("bsf %1, %0" : "=r"(index) : "rm"(value));
+    return index;
+}
+
+// Read the time-stamp counter
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+// Spin-loop hint
+static inline void cpu_relax(void) {
+    asm volatile("pause" : : : "memory");
+}
+
+// Disable interrupts, returning the previous EFLAGS for irq_restore
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+// Re-enable interrupts if they were enabled when irq_save was called
+static inline void irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+#endif // CPU_H
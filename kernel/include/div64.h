@@ -0,0 +1,37 @@
+#ifndef DIV64_H
+#define DIV64_H
+
+#include <stdint.h>
+
+// 64-bit by 32-bit division
+//
+// The kernel is not linked against libgcc, so plain 64-bit '/' and '%' would
+// leave __udivdi3/__umoddi3 unresolved. Two 32-bit DIVL steps give the full
+// 64-bit quotient instead.
+static inline uint64_t div_u64_rem(uint64_t dividend, uint32_t divisor, uint32_t* remainder) {
+    uint32_t high = (uint32_t)(dividend >> 32);
+    uint32_t low = (uint32_t)dividend;
+    uint32_t quotient_high = high / divisor;
+    uint32_t rem = high % divisor;
+    uint32_t quotient_low;
+
+    asm("divl %4" : "=a"(quotient_low), "=d"(rem) : "a"(low), "d"(rem), "rm"(divisor));
+
+    if (remainder) {
+        *remainder = rem;
+    }
+    return ((uint64_t)quotient_high << 32) | quotient_low;
+}
+
+static inline uint64_t div_u64(uint64_t dividend, uint32_t divisor) {
+    return div_u64_rem(dividend, divisor, 0);
+}
+
+// (a * mul) >> shift without losing the high bits of the 96-bit product, shift <= 32
+static inline uint64_t mul_u64_u32_shr(uint64_t a, uint32_t mul, uint32_t shift) {
+    uint64_t low = (uint64_t)(uint32_t)a * mul;
+    uint64_t high = (uint64_t)(uint32_t)(a >> 32) * mul;
+    return (low >> shift) + (high << (32 - shift));
+}
+
+#endif // DIV64_H
@@ -19,7 +19,39 @@ struct gdt_ptr {
     uint32_t base;           // Address of GDT
 } __attribute__((packed));
 
-// Initialize GDT
+// 32-bit task state segment
+struct tss_entry {
+    uint32_t prev_tss;
+    uint32_t esp0, ss0;      // Stack used on privilege change to ring 0
+    uint32_t esp1, ss1;
+    uint32_t esp2, ss2;
+    uint32_t cr3;
+    uint32_t eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;     // Offset of I/O permission bitmap (none if >= limit)
+} __attribute__((packed));
+
+// Segment selectors
+#define GDT_KERNEL_CODE   0x08
+#define GDT_KERNEL_DATA   0x10
+#define GDT_KERNEL_TSS    0x18   // Task register for normal execution
+#define GDT_DF_TSS        0x20   // Task entered through the double fault task gate
+#define GDT_PERCPU        0x28   // %fs: this CPU's struct cpu
+
+// Initialize the boot CPU's GDT and load the task register
 void gdt_init(void);
 
+// Same for any CPU: its own GDT, TSSs and per-CPU data segment
+void gdt_init_cpu(uint32_t index);
+
+// Page directory the calling CPU's double fault task switches to. gdt_init
+// takes the current one; paging_init moves it to the kernel directory.
+void gdt_set_double_fault_cr3(uint32_t cr3);
+
+// Task state saved by the CPU when a double fault switches tasks
+const struct tss_entry* gdt_get_kernel_tss(void);
+
 #endif // GDT_H
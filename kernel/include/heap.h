@@ -0,0 +1,57 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Cache line size used for slab object alignment
+#define CACHE_LINE_SIZE     64
+
+// kmalloc size classes: 16, 32, ..., 2048 bytes (larger requests use whole pages)
+#define HEAP_MIN_SHIFT      4
+#define HEAP_MAX_SHIFT      11
+#define HEAP_NUM_CLASSES    (HEAP_MAX_SHIFT - HEAP_MIN_SHIFT + 1)
+
+// Maximum number of slab caches (size classes included)
+#define HEAP_MAX_CACHES     32
+
+// Slab cache statistics
+struct kmem_cache_stats {
+    const char* name;
+    uint32_t object_size;     // Size of each object slot in bytes
+    uint32_t objects_in_use;  // Objects currently allocated
+    uint32_t slabs;           // Slabs currently owned by the cache
+    uint32_t slab_pages;      // Pages per slab
+    uint32_t alloc_count;     // Total allocations
+    uint32_t free_count;      // Total frees
+    uint32_t hits;            // Allocations served without asking for new pages
+};
+
+// Whole-heap statistics
+struct heap_stats {
+    uint32_t cache_count;
+    uint32_t large_allocs;    // Live allocations served directly from pages
+    uint32_t large_pages;     // Pages held by large allocations
+    uint32_t failed_count;    // Allocations that could not be satisfied
+};
+
+struct kmem_cache;
+
+// Initialize heap (requires the physical frame allocator)
+void heap_init(void);
+
+// General purpose allocation, memory is not zeroed
+void* kmalloc(size_t size);
+void* kzalloc(size_t size);
+void kfree(void* ptr);
+
+// Object caches: fixed-size objects, cache-line aligned, no constructors
+struct kmem_cache* kmem_cache_create(const char* name, size_t size);
+void* kmem_cache_alloc(struct kmem_cache* cache);
+void kmem_cache_free(struct kmem_cache* cache, void* obj);
+
+// Statistics
+void heap_get_stats(struct heap_stats* out);
+int heap_get_cache_stats(uint32_t index, struct kmem_cache_stats* out);
+
+#endif // HEAP_H
@@ -18,10 +18,19 @@ struct idt_ptr {
     uint32_t base;        // Address of IDT
 } __attribute__((packed));
 
+// Register state pushed by the ISR/IRQ stubs in isr.s (lowest address first)
+struct registers {
+    uint32_t ds;                                      // Saved data segment
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;  // Pushed by pusha
+    uint32_t int_no, err_code;                        // Pushed by the stub (err_code by CPU for some exceptions)
+    uint32_t eip, cs, eflags;                         // Pushed by the CPU
+};
+
 // IDT flags
 #define IDT_FLAG_PRESENT    0x80  // Segment is present
 #define IDT_FLAG_RING0      0x00  // Ring 0 (kernel)
 #define IDT_FLAG_RING3      0x60  // Ring 3 (user)
+#define IDT_FLAG_GATE_TASK  0x05  // Task gate
 #define IDT_FLAG_GATE_INT   0x0E  // 32-bit interrupt gate
 #define IDT_FLAG_GATE_TRAP  0x0F  // 32-bit trap gate
 
@@ -31,6 +40,14 @@ struct idt_ptr {
 // Initialize IDT
 void idt_init(void);
 
+// Load the (shared) IDT on another CPU
+void idt_load(void);
+
+// Common exception and IRQ handlers (called from isr.s)
+void isr_handler(struct registers* regs);
+void irq_handler(struct registers* regs);
+void double_fault_handler(uint32_t err_code);
+
 // Set an IDT gate
 void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags);
 
@@ -56,5 +73,38 @@ void pic_init(void);
 void pic_send_eoi(uint8_t irq);
 void pic_set_mask(uint8_t irq);
 void pic_clear_mask(uint8_t irq);
+void pic_disable(void);
+
+// Interrupt controller independent IRQ control (IOAPIC when enabled, else PIC)
+void irq_mask(uint8_t irq);
+void irq_unmask(uint8_t irq);
+void irq_eoi(uint8_t irq);
+
+// Return values of IRQ handlers: a shared line runs every handler on it and
+// counts the interrupt as unhandled when none claimed it
+#define IRQ_NONE        0
+#define IRQ_HANDLED     1
+
+// Vectors with a handler table entry (IRQ_OFFSET and up)
+#define IRQ_VECTORS     (256 - IRQ_OFFSET)
+#define IRQ_MAX_ACTIONS 32      // Handlers registered over all vectors
+
+// Add a handler for an interrupt line (vector IRQ_OFFSET + irq) or for any
+// vector, after those already registered. Handlers run with interrupts
+// disabled and cannot be removed. Returns 0 when the table is full.
+int irq_register(uint8_t irq, const char* name, int (*handler)(void* ctx), void* ctx);
+int irq_register_vector(uint8_t vector, const char* name, int (*handler)(void* ctx), void* ctx);
+
+// Counters of one vector, summed over all CPUs
+struct irq_stats {
+    const char* name;               // First handler's name (0 if none)
+    uint32_t handlers;
+    uint32_t count;
+    uint32_t unhandled;             // Interrupts no handler claimed
+    uint64_t cycles;                // TSC cycles spent in the handlers
+};
+
+// Statistics of a vector, returns 0 if it has no handler and never fired
+int irq_get_stats(uint8_t vector, struct irq_stats* out);
 
 #endif // IDT_H
@@ -8,8 +8,9 @@
 #define KEYBOARD_DATA_PORT    0x60
 #define KEYBOARD_STATUS_PORT  0x64
 
-// Keyboard buffer size
+// Keyboard buffer sizes (powers of two)
 #define KEYBOARD_BUFFER_SIZE  256
+#define SCANCODE_QUEUE_SIZE   64
 
 // Special keys
 #define KEY_BACKSPACE  '\b'
@@ -24,10 +25,14 @@ void keyboard_init(void);
 // Get character from keyboard buffer (blocking)
 char keyboard_getchar(void);
 
+// Queue and echo a decoded character (from softirqs; the serial console
+// feeds its input here too)
+void keyboard_input(char c);
+
 // Check if keyboard buffer has data
 bool keyboard_has_data(void);
 
-// Keyboard interrupt handler (called from ISR)
-void keyboard_handler(void);
+// Characters and scancodes lost to full buffers
+uint32_t keyboard_dropped(void);
 
 #endif // KEYBOARD_H
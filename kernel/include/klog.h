@@ -0,0 +1,44 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <stdint.h>
+
+// Log levels, most severe first
+enum klog_level {
+    KLOG_ERR,
+    KLOG_WARN,
+    KLOG_INFO,
+    KLOG_DEBUG,
+    KLOG_LEVELS,
+};
+
+// Ring geometry: fixed-size records, KLOG_RECORDS of them (a power of two)
+#define KLOG_RECORDS      512
+#define KLOG_RECORD_SIZE  128
+#define KLOG_TEXT_SIZE    (KLOG_RECORD_SIZE - 16)
+
+// Records at or above this severity are also printed on the console
+#define KLOG_CONSOLE_LEVEL KLOG_WARN
+
+// Log a message (kprintf format, truncated to KLOG_TEXT_SIZE - 1 bytes).
+// Never blocks, so it is safe from IRQ handlers; usable after gdt_init. The
+// console copy is printed later from a tasklet.
+void klog(enum klog_level level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Print the last count records at or above max_level severity to the
+// console, oldest first
+void klog_dump(uint32_t count, enum klog_level max_level);
+
+// Level name ("err", "warn", ...), or 0 past the last level
+const char* klog_level_name(uint32_t level);
+
+// Records logged since boot, and those overwritten before they were read
+// out to the console
+struct klog_stats {
+    uint32_t logged;
+    uint32_t console_missed;
+};
+
+void klog_get_stats(struct klog_stats* out);
+
+#endif // KLOG_H
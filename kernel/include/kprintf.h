@@ -0,0 +1,28 @@
+#ifndef KPRINTF_H
+#define KPRINTF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+// Formatted output
+//
+// Conversions: %d %i %u %x %X %p %s %c %%, with the flags '-' (left align),
+// '0' (zero pad) and '#' (0x prefix), a width (digits or '*'), a precision
+// for %s, and the length modifiers l (32-bit, as int), ll (64-bit), h and z.
+
+// Bytes kprintf formats before handing them to the terminal in one write
+#define KPRINTF_BUFFER 256
+
+// Print to the console. Output up to KPRINTF_BUFFER bytes reaches the
+// terminal in a single write, so it is not interleaved with other CPUs.
+// Returns the number of characters printed.
+int kprintf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+int kvprintf(const char* fmt, va_list ap);
+
+// Format into buf (always terminated when size > 0). Returns the length the
+// full output would have, which is >= size when it was truncated.
+int ksnprintf(char* buf, size_t size, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list ap);
+
+#endif // KPRINTF_H
@@ -0,0 +1,22 @@
+#ifndef KSYMS_H
+#define KSYMS_H
+
+#include <stdint.h>
+
+// Kernel symbol table: the text symbols of the kernel image, linked in by
+// the build (scripts/ksyms.sh)
+
+// Number of symbols (0 if the image was linked without a table)
+uint32_t ksym_total(void);
+
+// Index of the function containing addr, or -1 outside the kernel's code
+int32_t ksym_index(uint32_t addr);
+
+// Name and start address of symbol index
+const char* ksym_name(uint32_t index);
+uint32_t ksym_address(uint32_t index);
+
+// Name of the function containing addr and the offset into it, or 0
+const char* ksym_lookup(uint32_t addr, uint32_t* offset);
+
+#endif // KSYMS_H
@@ -0,0 +1,32 @@
+#ifndef MEMLAYOUT_H
+#define MEMLAYOUT_H
+
+#include <stdint.h>
+
+// Kernel virtual address space layout
+//
+//   0x00000000 - 0xBFFFFFFF  unmapped (reserved for future user space)
+//   0xC0000000 - 0xEFFFFFFF  direct map of physical memory (kernel image at +1 MiB)
+//   0xF0000000 - 0xFFFFFFFF  reserved for device (MMIO) mappings
+#define KERNEL_VIRT_BASE    0xC0000000
+#define DIRECT_MAP_SIZE     0x30000000
+#define MMIO_VIRT_BASE      (KERNEL_VIRT_BASE + DIRECT_MAP_SIZE)
+
+// Convert between physical addresses and direct map addresses
+#define PHYS_TO_VIRT(addr)  ((uint32_t)(addr) + KERNEL_VIRT_BASE)
+#define VIRT_TO_PHYS(addr)  ((uint32_t)(addr) - KERNEL_VIRT_BASE)
+
+// Linker-provided kernel image bounds (virtual)
+extern char _kernel_start[];
+extern char _kernel_end[];
+extern char _kernel_text_end[];   // End of .text
+
+// Boot stack (boot.s): guard page followed by the stack itself
+extern char boot_stack_guard[];
+extern char boot_stack_bottom[];
+extern char boot_stack_top[];
+
+// Page directory used during boot (identity + higher-half mapping)
+extern uint32_t boot_page_directory[];
+
+#endif // MEMLAYOUT_H
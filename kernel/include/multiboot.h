@@ -0,0 +1,44 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+
+// Value passed in EAX by a Multiboot-compliant bootloader
+#define MULTIBOOT_BOOTLOADER_MAGIC  0x2BADB002
+
+// Multiboot info flags (which fields are valid)
+#define MULTIBOOT_INFO_MEMORY       0x001   // mem_lower/mem_upper valid
+#define MULTIBOOT_INFO_MEM_MAP      0x040   // mmap_addr/mmap_length valid
+
+// Memory map entry types
+#define MULTIBOOT_MEMORY_AVAILABLE  1
+#define MULTIBOOT_MEMORY_RESERVED   2
+#define MULTIBOOT_MEMORY_ACPI       3
+#define MULTIBOOT_MEMORY_NVS        4
+#define MULTIBOOT_MEMORY_BADRAM     5
+
+// Multiboot information structure (fields we do not use are kept as padding)
+struct multiboot_info {
+    uint32_t flags;          // Which of the fields below are valid
+    uint32_t mem_lower;      // KiB of memory below 1 MiB
+    uint32_t mem_upper;      // KiB of memory above 1 MiB
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;    // Size of the memory map buffer in bytes
+    uint32_t mmap_addr;      // Physical address of the memory map
+} __attribute__((packed));
+
+// Memory map entry (size does not include the size field itself)
+struct multiboot_mmap_entry {
+    uint32_t size;
+    uint32_t base_low;
+    uint32_t base_high;
+    uint32_t length_low;
+    uint32_t length_high;
+    uint32_t type;
+} __attribute__((packed));
+
+#endif // MULTIBOOT_H
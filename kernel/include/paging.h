@@ -0,0 +1,54 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+
+// Page directory / page table entry flags
+#define PAGE_PRESENT    0x001   // Mapping is valid
+#define PAGE_WRITE      0x002   // Writable
+#define PAGE_USER       0x004   // Accessible from ring 3
+#define PAGE_PWT        0x008   // Write-through
+#define PAGE_PCD        0x010   // Cache disable
+#define PAGE_ACCESSED   0x020   // Set by CPU on access
+#define PAGE_DIRTY      0x040   // Set by CPU on write
+#define PAGE_LARGE      0x080   // PDE maps a 4 MiB page (PSE)
+#define PAGE_GLOBAL     0x100   // Keep TLB entry across CR3 reloads (PGE)
+
+// Page sizes
+#define LARGE_PAGE_SIZE 0x400000
+#define PAGE_TABLE_ENTRIES 1024
+
+// Address decomposition
+#define PDE_INDEX(addr)  ((uint32_t)(addr) >> 22)
+#define PTE_INDEX(addr)  (((uint32_t)(addr) >> 12) & 0x3FF)
+
+// Initialize and enable paging (requires the frame allocator)
+void paging_init(void);
+
+// Map one 4 KiB page, returns 0 on failure
+int paging_map_page(uint32_t virt, uint32_t phys, uint32_t flags);
+
+// Map one 4 MiB page (virt and phys 4 MiB aligned), returns 0 on failure
+int paging_map_large(uint32_t virt, uint32_t phys, uint32_t flags);
+
+// Remove the 4 KiB mapping for virt (splitting a 4 MiB page if necessary)
+void paging_unmap_page(uint32_t virt);
+
+// Page directory entry, and the page table behind it (0 for large/absent PDEs)
+uint32_t paging_get_pde(uint32_t index);
+const uint32_t* paging_get_table(uint32_t index);
+
+// Map a device range uncached into the MMIO window, returns its virtual
+// address (same page offset as phys) or 0 when the window is exhausted
+uint32_t paging_map_mmio(uint32_t phys, uint32_t size);
+
+// Physical memory covered by the direct map: [0, end) is at PHYS_TO_VIRT
+uint32_t paging_direct_map_end(void);
+
+// Physical address of the kernel page directory (for CR3 on other CPUs)
+uint32_t paging_get_cr3(void);
+
+// Whether global pages are in use (4 MiB pages always are)
+int paging_has_pge(void);
+
+#endif // PAGING_H
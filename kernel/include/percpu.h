@@ -0,0 +1,55 @@
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include <stdint.h>
+
+// Most CPUs brought online
+#define MAX_CPUS 16
+
+struct thread;
+struct registers;
+
+// Per-CPU data block, reached through the %fs segment of each CPU's GDT.
+// Blocks are cache-line aligned so CPUs never write to each other's lines.
+struct cpu {
+    struct cpu* self;         // Must stay first: this_cpu() loads it through %fs
+    uint32_t index;           // Dense CPU number, 0 is the boot CPU
+    uint32_t apic_id;
+    volatile int online;
+    uint8_t* stack;           // Boot stack of an application processor
+    struct thread* current;   // Thread running on this CPU
+    volatile uint32_t softirq_pending;  // Raised softirqs, one bit each
+    uint32_t bh_disable;      // Softirqs and preemption held off while non-zero
+    struct registers* irq_regs;  // Frame of the IRQ being handled, 0 outside one
+} __attribute__((aligned(64)));
+
+extern struct cpu cpu_data[MAX_CPUS];
+
+// Data block of the CPU we are running on (valid once its GDT is loaded).
+// Only stable while the caller cannot migrate (interrupts disabled).
+static inline struct cpu* this_cpu(void) {
+    struct cpu* cpu;
+    asm volatile("mov %%fs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+// Read a 32-bit field of this CPU's block in one instruction, so the value
+// belongs to one CPU even if the caller is preempted and migrated
+#define this_cpu_read(field) ({                                             \
+    __typeof__(((struct cpu*)0)->field) value__;                            \
+    asm volatile("mov %%fs:%c1, %0"                                         \
+                 : "=r"(value__) : "i"(__builtin_offsetof(struct cpu, field))); \
+    value__;                                                                \
+})
+
+// Increment or decrement a 32-bit field of this CPU's block in one
+// instruction (not locked: only this CPU writes its own counters)
+#define this_cpu_inc(field)                                                 \
+    asm volatile("incl %%fs:%c0"                                            \
+                 : : "i"(__builtin_offsetof(struct cpu, field)) : "memory")
+
+#define this_cpu_dec(field)                                                 \
+    asm volatile("decl %%fs:%c0"                                            \
+                 : : "i"(__builtin_offsetof(struct cpu, field)) : "memory")
+
+#endif // PERCPU_H
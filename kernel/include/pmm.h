@@ -0,0 +1,45 @@
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdint.h>
+#include "multiboot.h"
+#include "memlayout.h"
+
+// Page frame size
+#define PAGE_SIZE       4096
+#define PAGE_SHIFT      12
+
+// Frames managed by the allocator: only RAM reachable through the direct map
+#define PMM_MAX_FRAMES  (DIRECT_MAP_SIZE >> PAGE_SHIFT)
+
+// Largest buddy block is 2^PMM_MAX_ORDER frames (4 MiB)
+#define PMM_MAX_ORDER   10
+
+// Allocator statistics
+struct pmm_stats {
+    uint32_t total_frames;                     // Usable frames reported by the memory map
+    uint32_t end_frame;                        // One past the highest usable frame
+    uint32_t free_frames;                      // Frames currently free
+    uint32_t alloc_count;                      // Successful allocation calls
+    uint32_t free_count;                       // Free calls
+    uint32_t failed_count;                     // Allocation calls that found no memory
+    uint32_t free_blocks[PMM_MAX_ORDER + 1];   // Free blocks per buddy order
+};
+
+// Initialize allocator from the Multiboot memory map (mbi_phys is physical)
+void pmm_init(uint32_t magic, uint32_t mbi_phys);
+
+// Allocate one frame, returns its physical address or 0 when out of memory
+uint32_t pmm_alloc_frame(void);
+
+// Allocate count physically contiguous frames, returns physical address or 0
+uint32_t pmm_alloc_frames(uint32_t count);
+
+// Return frames obtained from pmm_alloc_frame/pmm_alloc_frames
+void pmm_free_frame(uint32_t addr);
+void pmm_free_frames(uint32_t addr, uint32_t count);
+
+// Snapshot of allocator statistics
+void pmm_get_stats(struct pmm_stats* out);
+
+#endif // PMM_H
@@ -2,11 +2,15 @@
 #define PRINT_H
 
 #include <stdint.h>
+#include "memlayout.h"
 
 // VGA text mode constants
 #define VGA_WIDTH  80
 #define VGA_HEIGHT 25
-#define VGA_MEMORY 0xB8000
+#define VGA_MEMORY PHYS_TO_VIRT(0xB8000)
+
+// Console history kept for scrolling back (a power of two)
+#define SCROLLBACK_LINES 4096
 
 // VGA color codes
 enum vga_color {
@@ -49,6 +53,18 @@ void terminal_writestring(const char* data);
 void terminal_scroll(void);
 void terminal_backspace(void);
 
+// Page through the scrollback: lines > 0 goes back, < 0 forward. Output
+// returns the view to the live screen.
+void terminal_scrollback(int32_t lines);
+
+// Take over the terminal for a panic: interrupts off, and output from here
+// on ignores the lock (which the crashed code may hold) and is drawn at once
+void terminal_panic(void);
+
+// Output is batched in a shadow buffer; this draws what is pending now
+// (lines are drawn when they end, partial output within a tick)
+void terminal_flush(void);
+
 // Legacy function (keep for compatibility)
 void print_string(const char *str);
 
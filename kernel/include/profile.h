@@ -0,0 +1,47 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+// Fastest sampling rate, in samples per scheduler tick
+#define PROFILE_MAX_MULTIPLIER  50
+
+// A function and the samples that landed in it
+struct profile_entry {
+    const char* name;         // 0 for samples outside the kernel's code
+    uint32_t samples;
+};
+
+struct profile_stats {
+    int active;
+    uint32_t multiplier;      // Samples per tick on each CPU
+    uint32_t samples;         // Since the last profile_start, all CPUs
+};
+
+// Clear the histograms and start sampling every CPU multiplier times per
+// tick (the LAPIC timer runs faster while profiling; without one the rate
+// stays at one sample per tick). Returns the multiplier in use, 0 if there
+// is no symbol table or no memory for the histograms.
+uint32_t profile_start(uint32_t multiplier);
+
+// Stop sampling, keeping the histograms for profile_top
+void profile_stop(void);
+
+// Scheduler tick on the calling CPU (thread_tick): takes a sample at the base
+// rate and moves the CPU to a new rate once profile_start/stop changed it
+void profile_tick(void);
+
+// LAPIC timer interrupt on the calling CPU: takes a sample at a raised rate.
+// Returns 1 if the interrupt is also a scheduler tick for this CPU.
+int profile_lapic_tick(void);
+
+// Whether the calling CPU's LAPIC timer is running for raised-rate samples
+int profile_lapic_busy(void);
+
+// Fill out with the max functions with the most samples, most first.
+// Returns the number of entries filled.
+uint32_t profile_top(struct profile_entry* out, uint32_t max);
+
+void profile_get_stats(struct profile_stats* out);
+
+#endif // PROFILE_H
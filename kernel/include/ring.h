@@ -0,0 +1,95 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include "atomic.h"
+
+// Lock-free single-producer single-consumer ring buffers
+//
+// RING_DEFINE(name, type) declares struct name and name_push, name_pop,
+// name_push_bulk, name_pop_bulk, name_count and name_empty for elements of
+// type. One context may push and one may pop concurrently (an IRQ handler
+// and a softirq, a softirq and a thread) without a lock; more of either
+// side need a lock of their own around that side.
+//
+// head and tail run freely and are masked on access, so the size must be a
+// power of two and all of it is usable. Each index is written by one side
+// only and sits on its own cache line. A full ring drops what does not fit
+// and counts it in overflows.
+//
+//     static uint8_t storage[64];
+//     static struct byte_ring ring = RING_INIT(storage);
+
+// Initializer for a ring over a static array (power-of-two length)
+#define RING_INIT(storage) { .slots = (storage), .mask = sizeof(storage) / sizeof((storage)[0]) - 1 }
+
+#define RING_DEFINE(name, type)                                                 \
+struct name {                                                                   \
+    type* slots;                                                                \
+    uint32_t mask;                  /* Size - 1 */                              \
+    volatile uint32_t head __attribute__((aligned(64)));  /* Producer only */   \
+    uint32_t overflows;             /* Elements dropped, ring full */           \
+    volatile uint32_t tail __attribute__((aligned(64)));  /* Consumer only */   \
+};                                                                              \
+                                                                                \
+static inline void name##_init(struct name* r, type* slots, uint32_t size) {    \
+    r->slots = slots;                                                           \
+    r->mask = size - 1;                                                         \
+    r->head = 0;                                                                \
+    r->overflows = 0;                                                           \
+    r->tail = 0;                                                                \
+}                                                                               \
+                                                                                \
+static inline uint32_t name##_count(const struct name* r) {                     \
+    return r->head - r->tail;                                                   \
+}                                                                               \
+                                                                                \
+static inline int name##_empty(const struct name* r) {                          \
+    return r->head == r->tail;                                                  \
+}                                                                               \
+                                                                                \
+/* Producer: copy up to n elements in, returns how many fit */                  \
+static inline uint32_t name##_push_bulk(struct name* r, const type* src, uint32_t n) { \
+    uint32_t head = r->head;                                                    \
+    uint32_t space = r->mask + 1 - (head - r->tail);                            \
+    if (n > space) {                                                            \
+        r->overflows += n - space;                                              \
+        n = space;                                                              \
+    }                                                                           \
+    for (uint32_t i = 0; i < n; i++) {                                          \
+        r->slots[(head + i) & r->mask] = src[i];                                \
+    }                                                                           \
+    smp_wmb();  /* Slots before the index that publishes them */                \
+    r->head = head + n;                                                         \
+    return n;                                                                   \
+}                                                                               \
+                                                                                \
+static inline int name##_push(struct name* r, type value) {                     \
+    return name##_push_bulk(r, &value, 1) != 0;                                 \
+}                                                                               \
+                                                                                \
+/* Consumer: copy up to n elements out, returns how many there were */         \
+static inline uint32_t name##_pop_bulk(struct name* r, type* dst, uint32_t n) { \
+    uint32_t tail = r->tail;                                                    \
+    uint32_t avail = r->head - tail;                                            \
+    smp_rmb();  /* The index before the slots it covers */                      \
+    if (n > avail) {                                                            \
+        n = avail;                                                              \
+    }                                                                           \
+    for (uint32_t i = 0; i < n; i++) {                                          \
+        dst[i] = r->slots[(tail + i) & r->mask];                                \
+    }                                                                           \
+    smp_release();  /* Slots read before the index hands them back */           \
+    r->tail = tail + n;                                                         \
+    return n;                                                                   \
+}                                                                               \
+                                                                                \
+static inline int name##_pop(struct name* r, type* out) {                       \
+    return name##_pop_bulk(r, out, 1) != 0;                                     \
+}
+
+// Rings shared by the drivers
+RING_DEFINE(byte_ring, uint8_t)
+RING_DEFINE(char_ring, char)
+
+#endif // RING_H
@@ -0,0 +1,60 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+
+// COM1 16550 UART
+#define SERIAL_COM1         0x3F8
+#define SERIAL_IRQ          4
+#define SERIAL_BAUD_DIVISOR 1       // 115200 baud
+
+// Register offsets from the base port
+#define UART_DATA           0       // RBR on read, THR on write (divisor low with DLAB)
+#define UART_IER            1       // Interrupt enable (divisor high with DLAB)
+#define UART_IIR            2       // Interrupt identification on read
+#define UART_FCR            2       // FIFO control on write
+#define UART_LCR            3       // Line control
+#define UART_MCR            4       // Modem control
+#define UART_LSR            5       // Line status
+
+#define UART_IER_RX         0x01    // Received data available
+#define UART_IER_TX         0x02    // Transmit holding register empty
+#define UART_IIR_NONE       0x01    // No interrupt pending
+#define UART_FCR_ENABLE     0x07    // Enable and clear both FIFOs
+#define UART_FCR_TRIGGER_14 0xC0    // RX interrupt at 14 bytes (or on timeout)
+#define UART_LCR_8N1        0x03
+#define UART_LCR_DLAB       0x80    // Divisor latch access
+#define UART_MCR_DTR        0x01
+#define UART_MCR_RTS        0x02
+#define UART_MCR_OUT2       0x08    // Gates the IRQ line on PC UARTs
+#define UART_MCR_LOOP       0x10
+#define UART_LSR_DR         0x01    // Data ready
+#define UART_LSR_THRE       0x20    // Transmit holding register (and FIFO) empty
+
+#define UART_FIFO_SIZE      16
+
+// Buffer sizes (powers of two)
+#define SERIAL_TX_SIZE      4096
+#define SERIAL_RX_SIZE      64
+
+// Set up COM1 and its FIFOs; output is polled until serial_start_irq.
+// Returns 0 when no UART answers.
+int serial_init(void);
+
+// Switch to interrupt-driven transmit and receive (once IRQs are routed)
+void serial_start_irq(void);
+
+// Queue one character ('\n' becomes CRLF, '\b' erases). One writer at a
+// time: the terminal calls it under its own lock.
+void serial_putc(char c);
+
+struct serial_stats {
+    uint32_t tx_bytes;
+    uint32_t rx_bytes;
+    uint32_t tx_bursts;             // FIFO refills
+    uint32_t tx_waits;              // Writer stalls on a full ring
+};
+
+void serial_get_stats(struct serial_stats* out);
+
+#endif // SERIAL_H
@@ -0,0 +1,28 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include "percpu.h"
+
+// Physical page the AP startup trampoline is copied to (below 1 MiB,
+// page aligned; the STARTUP IPI vector is its page number)
+#define TRAMPOLINE_BASE     0x8000
+
+// Stack each application processor starts on
+#define AP_STACK_SIZE       8192
+
+// INIT-SIPI-SIPI timing (microseconds)
+#define SMP_INIT_DELAY_US   10000
+#define SMP_SIPI_DELAY_US   200
+#define SMP_START_TIMEOUT_US 100000
+
+// Start every application processor listed in the MADT
+void smp_init(void);
+
+// Number of CPUs online (including the boot CPU)
+uint32_t smp_cpu_count(void);
+
+// Per-CPU data of CPU index, or 0 past the online CPUs
+struct cpu* smp_get_cpu(uint32_t index);
+
+#endif // SMP_H
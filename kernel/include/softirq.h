@@ -0,0 +1,64 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <stdint.h>
+#include "percpu.h"
+
+// Deferred interrupt work, run with interrupts enabled on IRQ exit
+enum softirq_nr {
+    SOFTIRQ_KEYBOARD,
+    SOFTIRQ_SERIAL,
+    SOFTIRQ_TASKLET,                // Runs scheduled tasklets
+    SOFTIRQ_COUNT,
+};
+
+// Rounds of re-raised softirqs run on one IRQ exit; anything raised after
+// that waits for the next interrupt
+#define SOFTIRQ_MAX_RESTART 10
+
+// One-shot deferred call, queued on the CPU that schedules it
+struct tasklet {
+    void (*func)(void* arg);
+    void* arg;
+    struct tasklet* next;
+    volatile uint32_t scheduled;    // Queued and not yet started
+};
+
+#define TASKLET_INIT(func, arg) { func, arg, 0, 0 }
+
+// Install the handler of a softirq (once, at init)
+void softirq_register(enum softirq_nr nr, const char* name, void (*handler)(void));
+
+// Mark a softirq pending on this CPU (call with interrupts disabled, usually
+// from an IRQ handler). It runs when the outermost interrupt returns.
+void softirq_raise(enum softirq_nr nr);
+
+// Run t->func once from this CPU's softirq; does nothing if already queued
+void tasklet_schedule(struct tasklet* t);
+
+// Keep softirqs (and preemption) off this CPU, for data shared with
+// softirqs. Sections nest; the last enable runs softirqs raised meanwhile.
+static inline void local_bh_disable(void) {
+    this_cpu_inc(bh_disable);
+}
+
+void local_bh_enable(void);
+
+// End of a hard interrupt: run pending softirqs, then preempt if asked
+// (called by irq_handler with interrupts disabled, after the EOI)
+void irq_exit(uint64_t entry_tsc);
+
+// Counters of one softirq, summed over all CPUs
+struct softirq_stats {
+    const char* name;
+    uint32_t runs;
+    uint64_t cycles;                // TSC cycles spent in the handler
+};
+
+int softirq_get_stats(uint32_t nr, struct softirq_stats* out);
+
+// Longest time a hard interrupt kept interrupts disabled (from the handler's
+// entry until softirqs re-enabled them or it returned), in TSC cycles
+uint64_t softirq_irq_off_max(void);
+
+#endif // SOFTIRQ_H
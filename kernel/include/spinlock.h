@@ -0,0 +1,205 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include "cpu.h"
+#include "atomic.h"
+#include "percpu.h"
+
+// Busy-waiting locks for data shared between CPUs
+//
+// Hold a lock with interrupts disabled (the _irqsave variants, or code that
+// already runs with interrupts off): that keeps interrupt handlers on the
+// same CPU from deadlocking on it and keeps the holder from being preempted.
+// Locks can be taken once gdt_init has set up the per-CPU segment.
+//
+// Every lock belongs to a lock class, which counts acquisitions, acquisitions
+// that had to wait and the TSC cycles spent waiting. Each CPU's counters fill
+// a cache line of their own, so counting does not bounce lines. The
+// uncontended path costs one locked instruction and one counter increment;
+// waiting loops only re-read the lock word, with pause, until it looks free.
+
+// Counters of one lock class on one CPU (padded to a cache line)
+struct lock_cpu_stats {
+    uint32_t acquisitions;
+    uint32_t contended;             // Acquisitions that had to wait
+    uint64_t spin_cycles;           // TSC cycles spent waiting
+} __attribute__((aligned(64)));
+
+// Statistics shared by every lock of one kind (e.g. all wait queue locks)
+struct lock_class {
+    const char* name;
+    struct lock_class* next;        // Registered classes
+    volatile uint32_t registered;
+    struct lock_cpu_stats cpu[MAX_CPUS];
+};
+
+#define LOCK_CLASS(var, name) struct lock_class var = { name, 0, 0, { { 0, 0, 0 } } }
+
+// Totals of one class, for lockstat
+struct lock_class_stats {
+    const char* name;
+    uint32_t acquisitions;
+    uint32_t contended;
+    uint64_t spin_cycles;
+};
+
+// Add a class to the lockstat list (done on its first acquisition)
+void lock_class_register(struct lock_class* class);
+
+// Totals of the index-th registered class, returns 0 past the end
+int lockstat_get(uint32_t index, struct lock_class_stats* out);
+
+// Zero every class's counters
+void lockstat_reset(void);
+
+static inline struct lock_cpu_stats* lock_stats(struct lock_class* class) {
+    if (!class->registered) {
+        lock_class_register(class);
+    }
+    return &class->cpu[this_cpu_read(index)];
+}
+
+// Test-and-test-and-set spinlock: cheapest when contention is rare
+struct spinlock {
+    volatile uint32_t locked;
+    struct lock_class* class;
+};
+
+#define SPINLOCK_INIT(class) { 0, class }
+
+// Ticket lock: waiters get the lock in arrival order, so a busy lock cannot
+// starve one CPU
+struct ticket_lock {
+    volatile uint32_t next;         // Next ticket to hand out
+    volatile uint32_t serving;      // Ticket allowed in
+    struct lock_class* class;
+};
+
+#define TICKET_LOCK_INIT(class) { 0, 0, class }
+
+// Reader-writer lock: any number of readers or one writer. A waiting writer
+// holds off new readers so a stream of readers cannot starve it, so a reader
+// must not take the lock again while holding it.
+struct rwlock {
+    volatile uint32_t value;        // Reader count plus the bits below
+    struct lock_class* class;
+};
+
+#define RWLOCK_WRITER       0x80000000u
+#define RWLOCK_WAITING      0x40000000u
+
+#define RWLOCK_INIT(class) { 0, class }
+
+// Contended paths (spinlock.c)
+void spin_lock_slow(struct spinlock* lock, struct lock_cpu_stats* stats);
+void ticket_lock_slow(struct ticket_lock* lock, uint32_t ticket, struct lock_cpu_stats* stats);
+void read_lock_slow(struct rwlock* lock, struct lock_cpu_stats* stats);
+void write_lock_slow(struct rwlock* lock, struct lock_cpu_stats* stats);
+
+static inline void spin_lock_init(struct spinlock* lock, struct lock_class* class) {
+    lock->locked = 0;
+    lock->class = class;
+}
+
+static inline void spin_lock(struct spinlock* lock) {
+    struct lock_cpu_stats* stats = lock_stats(lock->class);
+    if (atomic_xchg(&lock->locked, 1)) {
+        spin_lock_slow(lock, stats);
+    }
+    stats->acquisitions++;
+}
+
+static inline void spin_unlock(struct spinlock* lock) {
+    barrier();
+    lock->locked = 0;
+}
+
+// Disable interrupts and take the lock, returns the flags for the unlock
+static inline uint32_t spin_lock_irqsave(struct spinlock* lock) {
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(struct spinlock* lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+static inline void ticket_lock(struct ticket_lock* lock) {
+    struct lock_cpu_stats* stats = lock_stats(lock->class);
+    uint32_t ticket = atomic_add_return(&lock->next, 1) - 1;
+    if (lock->serving != ticket) {
+        ticket_lock_slow(lock, ticket, stats);
+    }
+    stats->acquisitions++;
+}
+
+static inline void ticket_unlock(struct ticket_lock* lock) {
+    // Only the holder writes serving
+    barrier();
+    lock->serving = lock->serving + 1;
+}
+
+static inline uint32_t ticket_lock_irqsave(struct ticket_lock* lock) {
+    uint32_t flags = irq_save();
+    ticket_lock(lock);
+    return flags;
+}
+
+static inline void ticket_unlock_irqrestore(struct ticket_lock* lock, uint32_t flags) {
+    ticket_unlock(lock);
+    irq_restore(flags);
+}
+
+static inline void read_lock(struct rwlock* lock) {
+    struct lock_cpu_stats* stats = lock_stats(lock->class);
+    uint32_t value = lock->value;
+    if ((value & (RWLOCK_WRITER | RWLOCK_WAITING)) ||
+        atomic_cmpxchg(&lock->value, value, value + 1) != value) {
+        read_lock_slow(lock, stats);
+    }
+    stats->acquisitions++;
+}
+
+static inline void read_unlock(struct rwlock* lock) {
+    atomic_add_return(&lock->value, -1u);
+}
+
+static inline void write_lock(struct rwlock* lock) {
+    struct lock_cpu_stats* stats = lock_stats(lock->class);
+    if (atomic_cmpxchg(&lock->value, 0, RWLOCK_WRITER) != 0) {
+        write_lock_slow(lock, stats);
+    }
+    stats->acquisitions++;
+}
+
+static inline void write_unlock(struct rwlock* lock) {
+    // Other writers may be setting RWLOCK_WAITING meanwhile
+    atomic_and(&lock->value, ~RWLOCK_WRITER);
+}
+
+static inline uint32_t read_lock_irqsave(struct rwlock* lock) {
+    uint32_t flags = irq_save();
+    read_lock(lock);
+    return flags;
+}
+
+static inline void read_unlock_irqrestore(struct rwlock* lock, uint32_t flags) {
+    read_unlock(lock);
+    irq_restore(flags);
+}
+
+static inline uint32_t write_lock_irqsave(struct rwlock* lock) {
+    uint32_t flags = irq_save();
+    write_lock(lock);
+    return flags;
+}
+
+static inline void write_unlock_irqrestore(struct rwlock* lock, uint32_t flags) {
+    write_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif // SPINLOCK_H
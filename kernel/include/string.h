@@ -15,8 +15,17 @@ char* strcat(char* dest, const char* src);
 // Memory functions
 void* memset(void* ptr, int value, size_t num);
 void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
 int memcmp(const void* ptr1, const void* ptr2, size_t n);
 
+// Choose the memcpy path from CPUID and enable SSE on the boot CPU (after
+// gdt_init); string_init_cpu enables it on each AP
+void string_init(void);
+void string_init_cpu(void);
+
+// Name of the large-copy path in use
+const char* string_memcpy_variant(void);
+
 // Conversion functions
 int atoi(const char* str);
 char* itoa(int value, char* str, int base);
@@ -0,0 +1,132 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+#include "percpu.h"
+
+// Kernel thread parameters
+#define THREAD_STACK_SIZE   8192
+#define THREAD_NAME_LEN     16
+
+// Multi-level feedback queue
+#define SCHED_PRIORITIES    8       // 0 is the highest priority
+#define SCHED_BASE_SLICE    2       // Slice at priority 0, doubling every two levels
+#define SCHED_BOOST_TICKS   100     // Period of the starvation-avoiding boost
+
+// Per-CPU run queues: one work-stealing deque per priority. Each deque can
+// hold every thread, so the thread count is capped at its size.
+#define SCHED_DEQUE_SIZE    128     // Power of two
+#define THREAD_MAX          SCHED_DEQUE_SIZE
+
+// Thread states
+enum thread_state {
+    THREAD_RUNNING,
+    THREAD_READY,
+    THREAD_BLOCKED,
+    THREAD_DEAD,
+};
+
+// Kernel thread control block
+struct thread {
+    uint32_t esp;                   // Saved stack pointer, must stay first (switch_context)
+    uint32_t id;
+    enum thread_state state;
+    char name[THREAD_NAME_LEN];
+    uint8_t* stack;                 // Stack allocation (0 for threads adopted from a boot flow)
+    void (*entry)(void*);
+    void* arg;
+    uint32_t priority;              // Current run queue (0 is the highest)
+    uint32_t slice_left;            // Ticks left in the current time slice
+    uint64_t ready_tsc;             // When the thread last became ready
+    uint32_t switches;              // Times this thread was switched in
+    uint32_t ticks;                 // Timer ticks spent running
+    uint32_t cpu;                   // CPU it last ran on (its home when pinned)
+    int pinned;                     // Never migrated to another CPU
+    volatile int on_cpu;            // Still running or switching out somewhere
+    int wake_pending;               // Woken while not blocked: next block returns at once
+    struct thread* next;            // Inbox / zombie list link
+    struct thread* all_next;        // List of all threads
+};
+
+// Snapshot of one thread for display
+struct thread_info {
+    uint32_t id;
+    enum thread_state state;
+    char name[THREAD_NAME_LEN];
+    uint32_t priority;
+    uint32_t cpu;
+    uint32_t switches;
+    uint32_t ticks;
+};
+
+// Scheduler statistics (summed over all CPUs)
+struct sched_stats {
+    uint32_t context_switches;
+    uint32_t preemptions;           // Switches forced on IRQ exit
+    uint32_t wakeups;               // Blocked threads made ready
+    uint32_t boosts;                // Periodic priority boosts
+    uint32_t queue_length[SCHED_PRIORITIES];
+    uint32_t latency_samples;       // Ready-to-running intervals measured
+    uint64_t latency_cycles;        // Sum of those intervals in TSC cycles
+    uint64_t latency_max;           // Longest interval in TSC cycles
+    uint32_t steals;                // Threads taken from another CPU's queues
+    uint32_t migrations;            // Threads switched in on a different CPU
+};
+
+// Scheduler statistics of one CPU
+struct sched_cpu_stats {
+    uint32_t context_switches;
+    uint32_t steals;
+    uint32_t migrations;
+    uint32_t runnable;              // Threads in its run queues
+    uint64_t idle_cycles;           // TSC cycles spent in its idle thread
+    uint64_t online_cycles;         // TSC cycles since it started scheduling
+};
+
+// Turn the boot flow of control into the first thread and create the idle thread
+void thread_init(void);
+
+// Turn an application processor's boot flow into its idle thread and run it
+void thread_start_cpu(void) __attribute__((noreturn));
+
+// Create a ready-to-run kernel thread, returns 0 on failure
+struct thread* thread_create(const char* name, void (*entry)(void*), void* arg);
+
+// Same, but the thread only ever runs on the calling CPU
+struct thread* thread_create_pinned(const char* name, void (*entry)(void*), void* arg);
+
+// Currently running thread
+struct thread* thread_current(void);
+
+// Give up the CPU to the next ready thread
+void thread_yield(void);
+
+// Block the calling thread until thread_wake (call with interrupts disabled).
+// A wakeup that arrives before the thread blocks makes it return at once, so
+// callers re-test their condition.
+void thread_block(void);
+
+// Make a blocked thread ready again, returns 0 if it was not blocked
+int thread_wake(struct thread* t);
+
+// Terminate the calling thread
+void thread_exit(void) __attribute__((noreturn));
+
+// Timer tick accounting (called from each CPU's tick interrupt)
+void thread_tick(void);
+
+// Switch threads if the tick asked for it (called on IRQ exit)
+void thread_preempt(void);
+
+// True when every online CPU has only its idle thread to run (interrupts
+// disabled)
+int thread_idle_now(void);
+
+
+// Statistics
+uint32_t thread_context_switches(void);
+int thread_get_info(uint32_t index, struct thread_info* out);
+void sched_get_stats(struct sched_stats* out);
+int sched_get_cpu_stats(uint32_t cpu, struct sched_cpu_stats* out);
+
+#endif // THREAD_H
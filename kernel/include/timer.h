@@ -8,17 +8,60 @@
 #define PIT_COMMAND     0x43     // Mode/command register
 #define PIT_CHANNEL0    0x40     // Channel 0 data port
 
+// PIT command bytes for channel 0, lobyte/hibyte access, binary
+#define PIT_CMD_ONESHOT  0x30    // Mode 0: interrupt on terminal count
+#define PIT_CMD_PERIODIC 0x36    // Mode 3: square wave
+#define PIT_CMD_LATCH    0x00    // Latch channel 0 count
+
+// Tickless idle statistics
+struct tickless_stats {
+    uint32_t oneshots;           // Idle periods programmed as one-shots
+    uint32_t lapic_oneshots;     // Of those, on the LAPIC timer
+    uint32_t early_wakes;        // One-shots cut short by another interrupt
+    uint32_t avoided;            // Timer interrupts that never had to fire
+    uint32_t ap_stops;           // Application processor ticks stopped in idle
+    uint32_t ap_avoided;         // Their timer interrupts that never fired
+};
+
 // Initialize PIT to generate interrupts at specified frequency
 void timer_init(uint32_t frequency);
 
 // Returns monotonic tick counter incremented by IRQ0
 uint32_t timer_get_ticks(void);
 
-// Busy-wait for specified tick count using HLT instruction
+// Tick rate in Hz
+uint32_t timer_get_frequency(void);
+
+// Block the calling thread for the specified number of ticks
 void timer_sleep(uint32_t ticks);
 
-// ISR callback invoked by IRQ0 handler
-void timer_handler(void);
+// Nanoseconds since boot from the TSC (tick resolution without one)
+uint64_t timer_get_ns(void);
+
+// Spin for a short precise delay on the TSC
+void timer_delay_us(uint32_t us);
+
+// Sleep whole ticks, then spin the remainder (sub-tick precision)
+void timer_sleep_us(uint32_t us);
+
+// Account idle time when a non-timer IRQ ends a tickless period (IRQ entry)
+void timer_irq_enter(void);
+
+// LAPIC timer interrupt: returns 1 if it ended the boot CPU's idle one-shot
+// and ran the tick
+int timer_lapic_irq(void);
+
+// Idle thread of the calling CPU about to halt with no work (interrupts
+// disabled): an application processor stops its tick
+void timer_idle_enter(void);
+
+// The calling CPU switches away from its idle thread: restart a stopped tick
+void timer_idle_exit(void);
+
+// Tickless idle control
+void timer_set_tickless(int enabled);
+int timer_get_tickless(void);
+void timer_get_tickless_stats(struct tickless_stats* out);
 
 // Returns elapsed time in seconds since timer initialization
 uint32_t timer_get_uptime_seconds(void);
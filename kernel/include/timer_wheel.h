@@ -0,0 +1,53 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+// Wheel geometry: 256 one-tick slots, then four levels of 64 coarser slots
+#define TIMER_WHEEL_ROOT_BITS   8
+#define TIMER_WHEEL_LEVEL_BITS  6
+#define TIMER_WHEEL_LEVELS      4
+
+// One-shot timer, embedded in its owner. The callback runs from the timer
+// interrupt on the boot CPU with interrupts disabled and may re-arm the timer.
+struct timer {
+    struct timer* next;
+    struct timer** pprev;           // Link pointing at us, 0 when not armed
+    uint32_t expires;               // Absolute tick
+    void (*callback)(void* arg);
+    void* arg;
+};
+
+// Wheel statistics
+struct timer_wheel_stats {
+    uint32_t pending;               // Armed timers
+    uint32_t expired;               // Callbacks run
+    uint32_t cascaded;              // Timers moved down a level
+};
+
+// Prepare a timer (not armed)
+void timer_setup(struct timer* timer, void (*callback)(void*), void* arg);
+
+// Arm (or re-arm) a timer to fire after delay ticks
+void timer_add(struct timer* timer, uint32_t delay);
+
+// Disarm a timer, returns 0 if it was not armed
+int timer_cancel(struct timer* timer);
+
+// Disarm a timer and wait until its callback is not running on another CPU,
+// so the timer can be freed (never call from the timer's own callback)
+int timer_cancel_sync(struct timer* timer);
+
+static inline int timer_pending(const struct timer* timer) {
+    return timer->pprev != 0;
+}
+
+// Run every timer due at or before now (called from the IRQ0 handler)
+void timer_wheel_run(uint32_t now);
+
+// Ticks from now until the wheel next needs to run, at most max
+uint32_t timer_wheel_idle_ticks(uint32_t max);
+
+void timer_wheel_get_stats(struct timer_wheel_stats* out);
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,37 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include <stdint.h>
+
+// PIT channel 2, gated through the keyboard controller's port B
+#define PIT_CHANNEL2        0x42
+#define PIT_PORT_B          0x61
+#define PIT_PORT_B_GATE2    0x01    // Channel 2 gate
+#define PIT_PORT_B_SPEAKER  0x02    // Speaker data enable
+#define PIT_PORT_B_OUT2     0x20    // Channel 2 output (read-only)
+#define PIT_CMD_CH2_ONESHOT 0xB0    // Channel 2, lobyte/hibyte, mode 0
+
+// Calibration window and attempts (shortest run wins)
+#define TSC_CALIBRATE_MS    10
+#define TSC_CALIBRATE_RUNS  5
+
+// Give up on a run after this many cycles (about 1 s at 4 GHz), in case
+// channel 2 is missing
+#define TSC_CALIBRATE_TIMEOUT 0xFFFFFFFFull
+
+// Measure the TSC rate against PIT channel 2, returns 0 without a usable TSC
+uint32_t tsc_init(void);
+
+// TSC rate in kHz (0 when unavailable)
+uint32_t tsc_get_khz(void);
+
+// True when CPUID reports an invariant TSC
+int tsc_is_invariant(void);
+
+// Convert a TSC cycle count to nanoseconds
+uint64_t tsc_to_ns(uint64_t cycles);
+
+// Nanoseconds since tsc_init
+uint64_t tsc_get_ns(void);
+
+#endif // TSC_H
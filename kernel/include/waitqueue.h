@@ -0,0 +1,48 @@
+#ifndef WAITQUEUE_H
+#define WAITQUEUE_H
+
+#include <stdint.h>
+#include "thread.h"
+#include "spinlock.h"
+
+// One sleeping thread, lives on the sleeper's stack
+struct wait_entry {
+    struct thread* thread;
+    struct wait_entry* next;
+    int queued;                     // Still linked (not yet taken by a waker)
+};
+
+// FIFO of threads waiting for one event
+struct wait_queue {
+    struct spinlock lock;
+    struct wait_entry* head;
+    struct wait_entry* tail;
+};
+
+// Lock class shared by every wait queue
+extern struct lock_class wait_queue_class;
+
+#define WAIT_QUEUE_INIT { SPINLOCK_INIT(&wait_queue_class), 0, 0 }
+
+void wait_queue_init(struct wait_queue* wq);
+
+// Block the calling thread on wq until woken. Call holding wq->lock (taken
+// with interrupts disabled), after testing the condition, and re-test it on
+// return; the lock is dropped while asleep and held again on return. Wakers
+// make the condition true before calling wake_up_*, so no wakeup is lost
+// between the test and the sleep even when they run on another CPU:
+//
+//     uint32_t flags = spin_lock_irqsave(&wq.lock);
+//     while (!condition) {
+//         wait_queue_sleep(&wq);
+//     }
+//     spin_unlock_irqrestore(&wq.lock, flags);
+void wait_queue_sleep(struct wait_queue* wq);
+
+// Wake the longest waiter, returns 0 if the queue was empty
+int wake_up_one(struct wait_queue* wq);
+
+// Wake every waiter, returns how many were woken
+uint32_t wake_up_all(struct wait_queue* wq);
+
+#endif // WAITQUEUE_H
@@ -61,15 +61,14 @@ ISR_NOERRCODE 31   # Reserved
 # Common ISR handler stub
 isr_common_stub:
     pusha              # Push all general purpose registers
+    cld                # C code expects DF clear (iret restores the caller's)
 
     mov %ds, %ax       # Save data segment
     push %eax
 
-    mov $0x10, %ax     # Load kernel data segment
+    mov $0x10, %ax     # Load kernel data segment (%fs stays on per-CPU data)
     mov %ax, %ds
     mov %ax, %es
-    mov %ax, %fs
-    mov %ax, %gs
 
     push %esp          # Push stack pointer (contains register state)
 
@@ -80,8 +79,6 @@ isr_common_stub:
     pop %eax           # Restore data segment
     mov %ax, %ds
     mov %ax, %es
-    mov %ax, %fs
-    mov %ax, %gs
 
     popa               # Pop all general purpose registers
     add $8, %esp       # Clean up error code and interrupt number
@@ -116,9 +113,29 @@ IRQ 13, 45  # FPU
 IRQ 14, 46  # Primary ATA
 IRQ 15, 47  # Secondary ATA
 
+# IOAPIC-only lines (GSIs 16-23, PCI interrupts)
+IRQ 16, 48
+IRQ 17, 49
+IRQ 18, 50
+IRQ 19, 51
+IRQ 20, 52
+IRQ 21, 53
+IRQ 22, 54
+IRQ 23, 55
+
+# LAPIC timer tick and reschedule IPI (see apic.h)
+IRQ 240, 0xF0
+IRQ 241, 0xF1
+
+# Spurious LAPIC interrupt: nothing to handle and no EOI allowed
+.global irq_spurious
+irq_spurious:
+    iret
+
 # Common IRQ handler stub
 irq_common_stub:
     pusha
+    cld                # The interrupted code may be in a backward rep movs
 
     mov %ds, %ax
     push %eax
@@ -126,8 +143,6 @@ irq_common_stub:
     mov $0x10, %ax
     mov %ax, %ds
     mov %ax, %es
-    mov %ax, %fs
-    mov %ax, %gs
 
     push %esp
 
@@ -138,14 +153,43 @@ irq_common_stub:
     pop %eax
     mov %ax, %ds
     mov %ax, %es
-    mov %ax, %fs
-    mov %ax, %gs
 
     popa
     add $8, %esp
     sti
     iret
 
+# Kernel thread context switch: switch_context(uint32_t* old_esp, uint32_t new_esp)
+# Only the callee-saved registers need saving; the caller (or the interrupt
+# frame below it, when preempting on IRQ exit) holds the rest.
+.global switch_context
+switch_context:
+    mov 4(%esp), %eax      # Where to store the outgoing stack pointer
+    mov 8(%esp), %edx      # Stack pointer to resume
+
+    push %ebp
+    push %ebx
+    push %esi
+    push %edi
+    mov %esp, (%eax)
+
+    mov %edx, %esp
+    pop %edi
+    pop %esi
+    pop %ebx
+    pop %ebp
+    ret
+
+# Double fault task entry (reached through a task gate, on its own stack)
+# The CPU pushed the error code, which becomes the C handler's argument.
+.global double_fault_task
+double_fault_task:
+    call double_fault_handler
+1:
+    cli
+    hlt
+    jmp 1b
+
 # IDT flush function
 .global idt_flush
 idt_flush:
@@ -3,26 +3,62 @@
 #include "include/idt.h"
 #include "include/print.h"
 #include "include/keyboard.h"
+#include "include/serial.h"
+#include "include/string.h"
 #include "include/timer.h"
 #include "include/shell.h"
+#include "include/multiboot.h"
+#include "include/pmm.h"
+#include "include/heap.h"
+#include "include/paging.h"
+#include "include/thread.h"
+#include "include/apic.h"
+#include "include/smp.h"
 
 // Main kernel function
-void kernel_main() {
+void kernel_main(uint32_t magic, uint32_t mbi_phys) {
     // Initialize terminal
     terminal_initialize();
 
     // Initialize GDT
     gdt_init();
 
+    // Pick memcpy/memset paths from CPUID (SSE2 needs this_cpu for its save area)
+    string_init();
+
+    // Mirror the console to COM1 (polled until its IRQ is routed)
+    serial_init();
+
     // Initialize IDT and PIC
     idt_init();
 
+    // Initialize physical frame allocator from the Multiboot memory map
+    pmm_init(magic, mbi_phys);
+
+    // Switch from the boot page directory to the kernel one (4 MiB global pages)
+    paging_init();
+
+    // Route IRQs through the LAPIC/IOAPIC when ACPI describes them (PIC otherwise)
+    apic_init();
+
+    // Initialize kernel heap on top of the frame allocator
+    heap_init();
+
+    // Turn the boot flow into the first kernel thread
+    thread_init();
+
     // Initialize timer (100 Hz = 100 ticks per second)
     timer_init(100);
 
+    // Start the other CPUs (needs the calibrated TSC for the INIT-SIPI delays)
+    smp_init();
+
     // Initialize keyboard
     keyboard_init();
 
+    // Serial console input and interrupt-driven output
+    serial_start_irq();
+
     // Initialize and run shell
     shell_init();
     shell_run();
@@ -2,17 +2,28 @@
 #include "include/port_io.h"
 #include "include/print.h"
 #include "include/idt.h"
+#include "include/waitqueue.h"
+#include "include/cpu.h"
+#include "include/softirq.h"
+#include "include/ring.h"
 
 // Keyboard state
 static bool shift_pressed = false;
 static bool caps_lock = false;
 static bool ctrl_pressed = false;
 static bool alt_pressed = false;
+static bool extended = false;      // Last scancode was the 0xE0 prefix
 
-// Circular keyboard buffer
+// Characters from the keyboard softirq to keyboard_getchar
 static char keyboard_buffer[KEYBOARD_BUFFER_SIZE];
-static uint32_t buffer_read_pos = 0;
-static uint32_t buffer_write_pos = 0;
+static struct char_ring keyboard_ring = RING_INIT(keyboard_buffer);
+
+// Scancodes from the IRQ handler to the softirq on the same CPU
+static uint8_t scancode_buffer[SCANCODE_QUEUE_SIZE];
+static struct byte_ring scancode_ring = RING_INIT(scancode_buffer);
+
+// Readers blocked in keyboard_getchar
+static struct wait_queue keyboard_wait = WAIT_QUEUE_INIT;
 
 // US QWERTY scancode to ASCII translation table
 // Index = scancode, Value = ASCII character (lowercase)
@@ -65,43 +76,75 @@ static const char scancode_to_ascii_shift[128] = {
 #define SC_ALT_PRESS      0x38
 #define SC_ALT_RELEASE    0xB8
 #define SC_CAPSLOCK       0x3A
-
-// Add character to keyboard buffer
-static void buffer_add(char c) {
-    uint32_t next_pos = (buffer_write_pos + 1) % KEYBOARD_BUFFER_SIZE;
-    if (next_pos != buffer_read_pos) {  // Buffer not full
-        keyboard_buffer[buffer_write_pos] = c;
-        buffer_write_pos = next_pos;
-    }
-}
+#define SC_EXTENDED       0xE0
+#define SC_PAGE_UP        0x49
+#define SC_PAGE_DOWN      0x51
 
 // Check if buffer has data
 bool keyboard_has_data(void) {
-    return buffer_read_pos != buffer_write_pos;
+    return !char_ring_empty(&keyboard_ring);
+}
+
+uint32_t keyboard_dropped(void) {
+    return keyboard_ring.overflows + scancode_ring.overflows;
 }
 
 // Get character from buffer (blocking)
 char keyboard_getchar(void) {
-    // Wait for data
-    while (!keyboard_has_data()) {
-        asm volatile("hlt");  // Halt until interrupt
+    // Sleep until the keyboard softirq queues a character
+    char c;
+    uint32_t flags = spin_lock_irqsave(&keyboard_wait.lock);
+    while (!char_ring_pop(&keyboard_ring, &c)) {
+        wait_queue_sleep(&keyboard_wait);
     }
-
-    // Read from buffer
-    char c = keyboard_buffer[buffer_read_pos];
-    buffer_read_pos = (buffer_read_pos + 1) % KEYBOARD_BUFFER_SIZE;
+    spin_unlock_irqrestore(&keyboard_wait.lock, flags);
     return c;
 }
 
-// Keyboard interrupt handler
-void keyboard_handler(void) {
-    // Read scancode from keyboard
-    uint8_t scancode = inb(KEYBOARD_DATA_PORT);
+// Queue a character for keyboard_getchar and echo it (softirq context).
+// The keyboard and serial softirqs both push to the single-producer ring:
+// that holds only because both IRQs are routed to the boot CPU, where
+// softirqs never run concurrently.
+void keyboard_input(char c) {
+    char_ring_push(&keyboard_ring, c);
+
+    // The scheduler boosts the woken reader, so it runs on IRQ exit
+    wake_up_one(&keyboard_wait);
+
+    // Echo character to screen
+    if (c == '\b') {
+        terminal_backspace();
+    } else {
+        terminal_putchar(c);
+    }
+}
+
+// Decode one scancode: track modifiers, queue and echo characters
+static void keyboard_process(uint8_t scancode) {
+    if (scancode == SC_EXTENDED) {
+        extended = true;
+        return;
+    }
+    bool was_extended = extended;
+    extended = false;
 
     // Check for key release (bit 7 set)
     bool key_released = (scancode & 0x80) != 0;
     uint8_t key_code = scancode & 0x7F;
 
+    // Shift+PageUp/PageDown page through the console history
+    if (shift_pressed && !key_released && (key_code == SC_PAGE_UP || key_code == SC_PAGE_DOWN)) {
+        int32_t page = VGA_HEIGHT - 1;
+        terminal_scrollback(key_code == SC_PAGE_UP ? page : -page);
+        return;
+    }
+
+    // Extended keys: right Ctrl/Alt act as modifiers, the rest (arrows,
+    // navigation, the fake shifts sent around them) type nothing
+    if (was_extended && key_code != (SC_CTRL_PRESS & 0x7F) && key_code != (SC_ALT_PRESS & 0x7F)) {
+        return;
+    }
+
     // Handle modifier keys
     if (scancode == SC_LSHIFT_PRESS || scancode == SC_RSHIFT_PRESS) {
         shift_pressed = true;
@@ -151,31 +194,43 @@ void keyboard_handler(void) {
         }
     }
 
-    // If we got a valid ASCII character, add to buffer and echo
     if (ascii != 0) {
-        buffer_add(ascii);
+        keyboard_input(ascii);
+    }
+}
 
-        // Echo character to screen
-        if (ascii == '\b') {
-            terminal_backspace();
-        } else {
-            terminal_putchar(ascii);
+// Keyboard softirq: everything but reading the port, with interrupts enabled
+static void keyboard_softirq(void) {
+    uint8_t scancodes[16];
+    uint32_t count;
+    while ((count = byte_ring_pop_bulk(&scancode_ring, scancodes, sizeof(scancodes))) != 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            keyboard_process(scancodes[i]);
         }
     }
 }
 
+// Keyboard interrupt handler (IRQ1): queue the scancode for the softirq
+static int keyboard_irq(void* ctx) {
+    (void)ctx;
+
+    // Dropped (and counted) if the softirq fell that far behind
+    byte_ring_push(&scancode_ring, inb(KEYBOARD_DATA_PORT));
+    softirq_raise(SOFTIRQ_KEYBOARD);
+    return IRQ_HANDLED;
+}
+
 // Initialize keyboard
 void keyboard_init(void) {
-    // Clear buffer
-    buffer_read_pos = 0;
-    buffer_write_pos = 0;
-
     // Reset keyboard state
     shift_pressed = false;
     caps_lock = false;
     ctrl_pressed = false;
     alt_pressed = false;
+    extended = false;
 
     // Enable keyboard IRQ (IRQ1)
-    pic_clear_mask(1);
+    softirq_register(SOFTIRQ_KEYBOARD, "keyboard", keyboard_softirq);
+    irq_register(1, "keyboard", keyboard_irq, 0);
+    irq_unmask(1);
 }
@@ -0,0 +1,170 @@
+#include "include/klog.h"
+#include "include/kprintf.h"
+#include "include/atomic.h"
+#include "include/percpu.h"
+#include "include/softirq.h"
+#include "include/string.h"
+#include "include/timer.h"
+#include "include/div64.h"
+
+// Kernel log
+//
+// A ring of fixed-size records. A writer claims the next sequence number
+// with one locked xadd on head, which is its slot; there is no lock, so IRQ
+// handlers and any CPU log concurrently. The slot's seq is cleared while the
+// record is filled in and set to seq + 1 to publish it. Readers copy a
+// record and check seq again afterwards, so one overwritten under them (the
+// ring wrapped) is dropped instead of shown torn.
+//
+// Records at KLOG_CONSOLE_LEVEL or above reach the console from a tasklet,
+// not from the caller. The drain stops at a record still being written; it
+// leaves its sequence number in console_wait, and that writer reschedules
+// the tasklet once it publishes.
+
+struct klog_record {
+    volatile uint32_t seq;          // seq + 1 once complete, 0 while written
+    uint8_t level;
+    uint8_t cpu;
+    uint16_t len;
+    uint64_t ns;                    // timer_get_ns when logged
+    char text[KLOG_TEXT_SIZE];
+};
+
+static struct klog_record records[KLOG_RECORDS];
+static volatile uint32_t head;      // Next sequence number
+static volatile uint32_t console_seq;
+static volatile uint32_t console_wait = ~0u;
+static volatile uint32_t draining;
+static uint32_t console_missed;
+
+static const char* level_names[KLOG_LEVELS] = { "err", "warn", "info", "debug" };
+
+static void console_drain(void* arg);
+static struct tasklet console_tasklet = TASKLET_INIT(console_drain, 0);
+
+void klog(enum klog_level level, const char* fmt, ...) {
+    uint32_t seq = atomic_add_return(&head, 1) - 1;
+    struct klog_record* r = &records[seq & (KLOG_RECORDS - 1)];
+
+    r->seq = 0;
+    smp_wmb();
+    r->level = level;
+    r->cpu = this_cpu()->index;
+    r->ns = timer_get_ns();
+
+    va_list ap;
+    va_start(ap, fmt);
+    int len = kvsnprintf(r->text, KLOG_TEXT_SIZE, fmt, ap);
+    va_end(ap);
+    r->len = len < KLOG_TEXT_SIZE ? len : KLOG_TEXT_SIZE - 1;
+
+    // Locked, so the console_wait check below cannot pass it
+    atomic_xchg(&r->seq, seq + 1);
+
+    if (level <= KLOG_CONSOLE_LEVEL || console_wait == seq) {
+        tasklet_schedule(&console_tasklet);
+    }
+}
+
+// Copy record seq out: 1 if it was complete, -1 if it is still being
+// written, 0 if it was overwritten
+static int read_record(uint32_t seq, struct klog_record* out) {
+    const struct klog_record* r = &records[seq & (KLOG_RECORDS - 1)];
+    uint32_t found = r->seq;
+    if (found != seq + 1) {
+        return found == 0 || found < seq + 1 ? -1 : 0;
+    }
+    smp_rmb();
+    memcpy(out, (const void*)r, sizeof(*out));
+    smp_rmb();
+    return r->seq == seq + 1;
+}
+
+static void print_record(const struct klog_record* rec) {
+    uint32_t usec;
+    uint32_t sec = (uint32_t)div_u64_rem(div_u64(rec->ns, 1000), 1000000, &usec);
+    kprintf("[%5u.%06u] %s\n", sec, usec, rec->text);
+}
+
+// read_record for the drain. A record still being written is left in
+// console_wait first, so its writer reschedules the drain once it is done.
+static int read_or_wait(uint32_t seq, struct klog_record* out) {
+    int state = read_record(seq, out);
+    if (state < 0) {
+        atomic_xchg(&console_wait, seq);
+        state = read_record(seq, out);
+    }
+    return state;
+}
+
+// Tasklet: print the records the console has not shown yet
+static void console_drain(void* arg) {
+    (void)arg;
+    struct klog_record rec;
+    do {
+        // One CPU drains at a time; the others' records are picked up below
+        if (atomic_xchg(&draining, 1)) {
+            return;
+        }
+
+        while (console_seq != head) {
+            uint32_t seq = console_seq;
+            if (head - seq > KLOG_RECORDS) {
+                console_missed += head - seq - KLOG_RECORDS;
+                seq = head - KLOG_RECORDS;
+            }
+
+            int state = read_or_wait(seq, &rec);
+            if (state < 0) {
+                break;
+            }
+            if (state == 0) {
+                console_missed++;
+            } else if (rec.level <= KLOG_CONSOLE_LEVEL) {
+                print_record(&rec);
+            }
+            console_seq = seq + 1;
+        }
+
+        atomic_xchg(&draining, 0);
+
+        // A tasklet scheduled while we held draining returned at once, so
+        // look again: stop only at an unfinished record, whose writer will
+        // schedule the drain
+    } while (console_seq != head && read_or_wait(console_seq, &rec) >= 0);
+}
+
+void klog_dump(uint32_t count, enum klog_level max_level) {
+    uint32_t end = head;
+    uint32_t start = end > KLOG_RECORDS ? end - KLOG_RECORDS : 0;
+    struct klog_record rec;
+
+    // Skip all but the last count matching records
+    uint32_t matching = 0;
+    for (uint32_t seq = start; seq != end; seq++) {
+        if (read_record(seq, &rec) > 0 && rec.level <= max_level) {
+            matching++;
+        }
+    }
+    uint32_t skip = matching > count ? matching - count : 0;
+
+    for (uint32_t seq = start; seq != end; seq++) {
+        if (read_record(seq, &rec) <= 0 || rec.level > max_level) {
+            continue;
+        }
+        if (skip) {
+            skip--;
+            continue;
+        }
+        print_record(&rec);
+    }
+}
+
+const char* klog_level_name(uint32_t level) {
+    return level < KLOG_LEVELS ? level_names[level] : 0;
+}
+
+void klog_get_stats(struct klog_stats* out) {
+    out->logged = head;
+    out->console_missed = console_missed;
+}
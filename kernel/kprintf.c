@@ -0,0 +1,297 @@
+#include "include/kprintf.h"
+#include "include/print.h"
+#include "include/div64.h"
+
+// printf engine
+//
+// Output goes through a small sink: ksnprintf fills the caller's buffer and
+// counts what did not fit, kprintf fills a buffer on its stack and hands it
+// to terminal_write whole (again whenever it fills up). Decimal conversion
+// produces two digits per division from a table of the pairs 00..99, and
+// 64-bit values are split into 9-digit chunks with one div_u64_rem each, as
+// there is no libgcc for a 64-bit divide.
+
+struct sink {
+    char* buf;
+    size_t size;                    // Capacity of buf
+    size_t pos;                     // Bytes in buf
+    size_t total;                   // Bytes produced overall
+    int to_terminal;                // Flush to the terminal when full
+};
+
+static const char digit_pairs[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static void sink_flush(struct sink* out) {
+    if (out->to_terminal && out->pos) {
+        terminal_write(out->buf, out->pos);
+        out->pos = 0;
+    }
+}
+
+static void sink_put(struct sink* out, char c) {
+    if (out->pos >= out->size) {
+        if (!out->to_terminal) {
+            out->total++;
+            return;
+        }
+        sink_flush(out);
+    }
+    out->buf[out->pos++] = c;
+    out->total++;
+}
+
+static void sink_repeat(struct sink* out, char c, int count) {
+    while (count-- > 0) {
+        sink_put(out, c);
+    }
+}
+
+// Write value in decimal backwards ending at end, returns the first digit
+static char* format_u32(uint32_t value, char* end) {
+    while (value >= 100) {
+        uint32_t q = value / 100;
+        uint32_t r = value - q * 100;
+        end -= 2;
+        end[0] = digit_pairs[r * 2];
+        end[1] = digit_pairs[r * 2 + 1];
+        value = q;
+    }
+    if (value >= 10) {
+        end -= 2;
+        end[0] = digit_pairs[value * 2];
+        end[1] = digit_pairs[value * 2 + 1];
+    } else {
+        *--end = '0' + value;
+    }
+    return end;
+}
+
+static char* format_u64(uint64_t value, char* end) {
+    // Peel off 9 digits at a time until the rest fits 32 bits
+    while (value >> 32) {
+        uint32_t low;
+        value = div_u64_rem(value, 1000000000, &low);
+        char* start = format_u32(low, end);
+        while (start > end - 9) {
+            *--start = '0';
+        }
+        end = start;
+    }
+    return format_u32((uint32_t)value, end);
+}
+
+static char* format_hex(uint64_t value, char* end, int upper) {
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    do {
+        *--end = digits[value & 0xF];
+        value >>= 4;
+    } while (value);
+    return end;
+}
+
+#define FLAG_LEFT   0x01
+#define FLAG_ZERO   0x02
+#define FLAG_ALT    0x04
+
+// Emit a field: prefix ("-" or "0x"), then the digits, padded to width
+static void emit_field(struct sink* out, const char* prefix, const char* digits, int len,
+                       int width, uint32_t flags) {
+    int prefix_len = 0;
+    while (prefix[prefix_len]) {
+        prefix_len++;
+    }
+    int pad = width - prefix_len - len;
+
+    if (!(flags & (FLAG_LEFT | FLAG_ZERO))) {
+        sink_repeat(out, ' ', pad);
+    }
+    for (int i = 0; i < prefix_len; i++) {
+        sink_put(out, prefix[i]);
+    }
+    if ((flags & FLAG_ZERO) && !(flags & FLAG_LEFT)) {
+        sink_repeat(out, '0', pad);
+    }
+    for (int i = 0; i < len; i++) {
+        sink_put(out, digits[i]);
+    }
+    if (flags & FLAG_LEFT) {
+        sink_repeat(out, ' ', pad);
+    }
+}
+
+static void format(struct sink* out, const char* fmt, va_list ap) {
+    char number[24];
+    char* end = number + sizeof(number);
+
+    for (; *fmt; fmt++) {
+        if (*fmt != '%') {
+            sink_put(out, *fmt);
+            continue;
+        }
+
+        // Flags
+        uint32_t flags = 0;
+        for (;;) {
+            fmt++;
+            if (*fmt == '-') {
+                flags |= FLAG_LEFT;
+            } else if (*fmt == '0') {
+                flags |= FLAG_ZERO;
+            } else if (*fmt == '#') {
+                flags |= FLAG_ALT;
+            } else {
+                break;
+            }
+        }
+
+        // Width and precision
+        int width = 0;
+        if (*fmt == '*') {
+            width = va_arg(ap, int);
+            if (width < 0) {
+                flags |= FLAG_LEFT;
+                width = -width;
+            }
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') {
+                width = width * 10 + (*fmt++ - '0');
+            }
+        }
+        int precision = -1;
+        if (*fmt == '.') {
+            fmt++;
+            precision = 0;
+            if (*fmt == '*') {
+                precision = va_arg(ap, int);
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9') {
+                    precision = precision * 10 + (*fmt++ - '0');
+                }
+            }
+        }
+
+        // Length: only ll changes the argument size on i386
+        int wide = 0;
+        while (*fmt == 'l' || *fmt == 'h' || *fmt == 'z') {
+            if (fmt[0] == 'l' && fmt[1] == 'l') {
+                wide = 1;
+                fmt++;
+            }
+            fmt++;
+        }
+
+        const char* prefix = "";
+        char* digits;
+        switch (*fmt) {
+        case 'd':
+        case 'i': {
+            int64_t value = wide ? va_arg(ap, int64_t) : va_arg(ap, int32_t);
+            uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+            if (value < 0) {
+                prefix = "-";
+            }
+            digits = format_u64(magnitude, end);
+            emit_field(out, prefix, digits, end - digits, width, flags);
+            break;
+        }
+        case 'u': {
+            uint64_t value = wide ? va_arg(ap, uint64_t) : va_arg(ap, uint32_t);
+            digits = format_u64(value, end);
+            emit_field(out, prefix, digits, end - digits, width, flags);
+            break;
+        }
+        case 'x':
+        case 'X': {
+            uint64_t value = wide ? va_arg(ap, uint64_t) : va_arg(ap, uint32_t);
+            if (flags & FLAG_ALT) {
+                prefix = "0x";
+            }
+            digits = format_hex(value, end, *fmt == 'X');
+            emit_field(out, prefix, digits, end - digits, width, flags);
+            break;
+        }
+        case 'p': {
+            // Always the full 8 digits
+            uint32_t value = (uint32_t)va_arg(ap, void*);
+            digits = format_hex(value, end, 0);
+            while (digits > end - 8) {
+                *--digits = '0';
+            }
+            emit_field(out, "0x", digits, end - digits, width, flags & FLAG_LEFT);
+            break;
+        }
+        case 's': {
+            const char* str = va_arg(ap, const char*);
+            if (str == 0) {
+                str = "(null)";
+            }
+            int len = 0;
+            while (str[len] && (precision < 0 || len < precision)) {
+                len++;
+            }
+            emit_field(out, prefix, str, len, width, flags & FLAG_LEFT);
+            break;
+        }
+        case 'c': {
+            char c = (char)va_arg(ap, int);
+            emit_field(out, prefix, &c, 1, width, flags & FLAG_LEFT);
+            break;
+        }
+        case '%':
+            sink_put(out, '%');
+            break;
+        case '\0':
+            return;
+        default:
+            // Unknown conversion: print it as written
+            sink_put(out, '%');
+            sink_put(out, *fmt);
+            break;
+        }
+    }
+}
+
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list ap) {
+    struct sink out = { buf, size ? size - 1 : 0, 0, 0, 0 };
+    format(&out, fmt, ap);
+    if (size) {
+        buf[out.pos] = '\0';
+    }
+    return (int)out.total;
+}
+
+int ksnprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int len = kvsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+int kvprintf(const char* fmt, va_list ap) {
+    char buffer[KPRINTF_BUFFER];
+    struct sink out = { buffer, sizeof(buffer), 0, 0, 1 };
+    format(&out, fmt, ap);
+    sink_flush(&out);
+    return (int)out.total;
+}
+
+int kprintf(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int len = kvprintf(fmt, ap);
+    va_end(ap);
+    return len;
+}
@@ -0,0 +1,55 @@
+#include "include/ksyms.h"
+#include "include/memlayout.h"
+
+// Kernel symbol table
+//
+// The build links the kernel twice: once with an empty table, then again
+// with the text symbols of that first image, sorted by address, as three
+// parallel arrays in .rodata. A lookup is a binary search for the last
+// symbol at or below the address.
+
+extern const uint32_t ksym_count;
+extern const uint32_t ksym_addrs[];
+extern const uint32_t ksym_name_offsets[];
+extern const char ksym_names[];
+
+uint32_t ksym_total(void) {
+    return ksym_count;
+}
+
+int32_t ksym_index(uint32_t addr) {
+    if (ksym_count == 0 || addr < ksym_addrs[0] || addr >= (uint32_t)_kernel_text_end) {
+        return -1;
+    }
+
+    uint32_t low = 0;
+    uint32_t high = ksym_count;
+    while (high - low > 1) {
+        uint32_t mid = (low + high) / 2;
+        if (ksym_addrs[mid] <= addr) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return (int32_t)low;
+}
+
+const char* ksym_name(uint32_t index) {
+    return index < ksym_count ? &ksym_names[ksym_name_offsets[index]] : 0;
+}
+
+uint32_t ksym_address(uint32_t index) {
+    return index < ksym_count ? ksym_addrs[index] : 0;
+}
+
+const char* ksym_lookup(uint32_t addr, uint32_t* offset) {
+    int32_t index = ksym_index(addr);
+    if (index < 0) {
+        return 0;
+    }
+    if (offset) {
+        *offset = addr - ksym_addrs[index];
+    }
+    return ksym_name(index);
+}
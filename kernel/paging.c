@@ -0,0 +1,202 @@
+#include "include/paging.h"
+#include "include/pmm.h"
+#include "include/cpu.h"
+#include "include/string.h"
+#include "include/memlayout.h"
+#include "include/gdt.h"
+
+// Kernel page directory
+//
+// Physical memory is mapped at KERNEL_VIRT_BASE with 4 MiB PSE pages marked
+// global, so the whole kernel and all RAM cost one TLB entry per 4 MiB and
+// those entries survive CR3 reloads. Page tables are only created where 4 KiB
+// granularity is needed (the boot stack guard page, the MMIO window). PSE is
+// required: boot.s already runs on 4 MiB pages before paging_init.
+// Nothing below KERNEL_VIRT_BASE is mapped, so null pointers fault.
+static uint32_t page_directory[PAGE_TABLE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+
+static int pge_enabled = 0;
+static int paging_enabled = 0;
+static uint32_t direct_map_end = 0;     // Physical bytes mapped by the direct map
+
+// Next free address in the MMIO window (mappings are never removed)
+static uint32_t mmio_next = MMIO_VIRT_BASE;
+
+// Flags carried over when a 4 MiB page is split into 4 KiB pages
+#define PAGE_INHERIT_FLAGS (PAGE_WRITE | PAGE_USER | PAGE_PWT | PAGE_PCD | PAGE_GLOBAL)
+
+static inline void flush_page(uint32_t virt) {
+    if (paging_enabled) {
+        invlpg(virt);
+    }
+}
+
+// Replace the 4 MiB mapping at index with an equivalent page table
+static uint32_t* split_large(uint32_t index) {
+    uint32_t pde = page_directory[index];
+    uint32_t table_phys = pmm_alloc_frame();
+    if (table_phys == 0) {
+        return 0;
+    }
+
+    uint32_t* table = (uint32_t*)PHYS_TO_VIRT(table_phys);
+    uint32_t base = pde & 0xFFC00000;
+    uint32_t flags = (pde & PAGE_INHERIT_FLAGS) | PAGE_PRESENT;
+    for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+        table[i] = (base + i * PAGE_SIZE) | flags;
+    }
+
+    page_directory[index] = table_phys | PAGE_PRESENT | PAGE_WRITE;
+    flush_page(index << 22);
+    return table;
+}
+
+// Page table for a directory index, created (or split from a 4 MiB page) on demand
+static uint32_t* get_table(uint32_t index, int create) {
+    uint32_t pde = page_directory[index];
+
+    if (pde & PAGE_PRESENT) {
+        if (pde & PAGE_LARGE) {
+            return create ? split_large(index) : 0;
+        }
+        return (uint32_t*)PHYS_TO_VIRT(pde & ~0xFFF);
+    }
+
+    if (!create) {
+        return 0;
+    }
+
+    uint32_t table_phys = pmm_alloc_frame();
+    if (table_phys == 0) {
+        return 0;
+    }
+    uint32_t* table = (uint32_t*)PHYS_TO_VIRT(table_phys);
+    memset(table, 0, PAGE_SIZE);
+    page_directory[index] = table_phys | PAGE_PRESENT | PAGE_WRITE;
+    return table;
+}
+
+// Map one 4 KiB page
+int paging_map_page(uint32_t virt, uint32_t phys, uint32_t flags) {
+    uint32_t* table = get_table(PDE_INDEX(virt), 1);
+    if (table == 0) {
+        return 0;
+    }
+
+    table[PTE_INDEX(virt)] = (phys & ~0xFFF) | (flags & 0xFFF & ~PAGE_LARGE) | PAGE_PRESENT;
+    flush_page(virt);
+    return 1;
+}
+
+// Map one 4 MiB page
+int paging_map_large(uint32_t virt, uint32_t phys, uint32_t flags) {
+    if ((virt & (LARGE_PAGE_SIZE - 1)) || (phys & (LARGE_PAGE_SIZE - 1))) {
+        return 0;
+    }
+
+    // Drop any page table previously covering this range
+    uint32_t index = PDE_INDEX(virt);
+    uint32_t pde = page_directory[index];
+    if ((pde & PAGE_PRESENT) && !(pde & PAGE_LARGE)) {
+        pmm_free_frame(pde & ~0xFFF);
+    }
+
+    page_directory[index] = phys | (flags & 0xFFF) | PAGE_LARGE | PAGE_PRESENT;
+    flush_page(virt);
+    return 1;
+}
+
+// Remove one 4 KiB mapping
+void paging_unmap_page(uint32_t virt) {
+    uint32_t* table = get_table(PDE_INDEX(virt), (page_directory[PDE_INDEX(virt)] & PAGE_LARGE) != 0);
+    if (table == 0) {
+        return;
+    }
+
+    table[PTE_INDEX(virt)] = 0;
+    flush_page(virt);
+}
+
+uint32_t paging_map_mmio(uint32_t phys, uint32_t size) {
+    uint32_t offset = phys & 0xFFF;
+    uint32_t pages = (offset + size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    // Space left up to the top of the address space
+    if (mmio_next == 0 || pages > (0 - mmio_next) / PAGE_SIZE) {
+        return 0;
+    }
+
+    uint32_t virt = mmio_next;
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t page_phys = (phys & ~0xFFF) + i * PAGE_SIZE;
+        if (!paging_map_page(virt + i * PAGE_SIZE, page_phys, PAGE_WRITE | PAGE_PCD | PAGE_PWT)) {
+            return 0;
+        }
+    }
+
+    mmio_next += pages * PAGE_SIZE;
+    return virt + offset;
+}
+
+uint32_t paging_get_pde(uint32_t index) {
+    return index < PAGE_TABLE_ENTRIES ? page_directory[index] : 0;
+}
+
+const uint32_t* paging_get_table(uint32_t index) {
+    if (index >= PAGE_TABLE_ENTRIES) {
+        return 0;
+    }
+    return get_table(index, 0);
+}
+
+uint32_t paging_direct_map_end(void) {
+    return direct_map_end;
+}
+
+uint32_t paging_get_cr3(void) {
+    return VIRT_TO_PHYS(page_directory);
+}
+
+int paging_has_pge(void) {
+    return pge_enabled;
+}
+
+// Build the kernel page directory and switch to it from the boot directory
+void paging_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    pge_enabled = (edx & CPUID_FEAT_EDX_PGE) != 0;
+
+    uint32_t global = pge_enabled ? PAGE_GLOBAL : 0;
+
+    // Direct map all RAM below the MMIO window, at least the kernel and boot stack
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+    uint32_t large_pages = (stats.end_frame + PAGE_TABLE_ENTRIES - 1) / PAGE_TABLE_ENTRIES;
+    uint32_t min_pages = VIRT_TO_PHYS(boot_stack_top) / LARGE_PAGE_SIZE + 1;
+    if (large_pages < min_pages) {
+        large_pages = min_pages;
+    }
+    if (large_pages > DIRECT_MAP_SIZE / LARGE_PAGE_SIZE) {
+        large_pages = DIRECT_MAP_SIZE / LARGE_PAGE_SIZE;
+    }
+
+    for (uint32_t i = 0; i < large_pages; i++) {
+        uint32_t phys = i * LARGE_PAGE_SIZE;
+        paging_map_large(PHYS_TO_VIRT(phys), phys, PAGE_WRITE | global);
+    }
+
+    direct_map_end = large_pages * LARGE_PAGE_SIZE;
+
+    // Stack overflow now faults instead of running into memory below the stack
+    paging_unmap_page((uint32_t)boot_stack_guard);
+
+    // Leave the boot directory (and its identity mapping), then enable global pages
+    write_cr3(VIRT_TO_PHYS(page_directory));
+    gdt_set_double_fault_cr3(VIRT_TO_PHYS(page_directory));
+    if (pge_enabled) {
+        write_cr4(read_cr4() | CR4_PGE);
+    }
+
+    paging_enabled = 1;
+}
@@ -0,0 +1,302 @@
+#include "include/pmm.h"
+#include "include/string.h"
+#include "include/cpu.h"
+#include "include/spinlock.h"
+
+// Physical frame allocator (binary buddy system)
+//
+// Free blocks of 2^order frames are kept on one doubly-linked list per order.
+// The list node lives in the first frame of the free block itself, so the only
+// static cost is one bit per frame marking the head of a free block. A mask of
+// non-empty orders lets allocation find a block with a single bit scan;
+// splitting and coalescing walk at most PMM_MAX_ORDER levels.
+
+// Free block header stored in the first frame of every free block
+struct free_block {
+    struct free_block* next;
+    struct free_block* prev;
+    uint32_t order;
+};
+
+static struct free_block* free_lists[PMM_MAX_ORDER + 1];
+static uint32_t free_order_mask = 0;   // Bit k set when free_lists[k] is non-empty
+
+// One bit per frame: set when the frame heads a free block
+static uint32_t free_head_bitmap[PMM_MAX_FRAMES / 32];
+
+static struct pmm_stats stats;
+static LOCK_CLASS(pmm_class, "pmm");
+static struct spinlock pmm_lock = SPINLOCK_INIT(&pmm_class);
+
+// Reserved physical ranges excluded while building the free lists
+#define PMM_MAX_RESERVED 6
+struct phys_range {
+    uint32_t start_frame;
+    uint32_t end_frame;    // Exclusive
+};
+static struct phys_range reserved[PMM_MAX_RESERVED];
+static uint32_t reserved_count = 0;
+
+// Map a frame number to its header through the direct map
+static inline struct free_block* frame_to_block(uint32_t frame) {
+    return (struct free_block*)PHYS_TO_VIRT(frame << PAGE_SHIFT);
+}
+
+static inline uint32_t block_to_frame(struct free_block* block) {
+    return VIRT_TO_PHYS(block) >> PAGE_SHIFT;
+}
+
+static inline int is_free_head(uint32_t frame) {
+    return (free_head_bitmap[frame / 32] >> (frame % 32)) & 1;
+}
+
+// Push a free block on the list for its order
+static void list_push(uint32_t frame, uint32_t order) {
+    struct free_block* block = frame_to_block(frame);
+
+    block->order = order;
+    block->prev = 0;
+    block->next = free_lists[order];
+    if (block->next) {
+        block->next->prev = block;
+    }
+    free_lists[order] = block;
+
+    free_order_mask |= (1u << order);
+    free_head_bitmap[frame / 32] |= (1u << (frame % 32));
+    stats.free_blocks[order]++;
+}
+
+// Unlink a free block from the list for its order
+static void list_remove(struct free_block* block, uint32_t order) {
+    uint32_t frame = block_to_frame(block);
+
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        free_lists[order] = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+
+    if (free_lists[order] == 0) {
+        free_order_mask &= ~(1u << order);
+    }
+    free_head_bitmap[frame / 32] &= ~(1u << (frame % 32));
+    stats.free_blocks[order]--;
+}
+
+// Insert a 2^order block, merging with its buddy while possible
+static void free_block(uint32_t frame, uint32_t order) {
+    while (order < PMM_MAX_ORDER) {
+        uint32_t buddy = frame ^ (1u << order);
+        if (buddy >= PMM_MAX_FRAMES || !is_free_head(buddy)) {
+            break;
+        }
+
+        struct free_block* block = frame_to_block(buddy);
+        if (block->order != order) {
+            break;
+        }
+
+        list_remove(block, order);
+        frame &= ~(1u << order);
+        order++;
+    }
+
+    list_push(frame, order);
+}
+
+// Free an arbitrary frame range as a sequence of aligned power-of-two blocks
+static void free_range(uint32_t frame, uint32_t count) {
+    while (count > 0) {
+        uint32_t order = frame ? (uint32_t)__builtin_ctz(frame) : PMM_MAX_ORDER;
+        if (order > PMM_MAX_ORDER) {
+            order = PMM_MAX_ORDER;
+        }
+        while ((1u << order) > count) {
+            order--;
+        }
+
+        free_block(frame, order);
+        frame += 1u << order;
+        count -= 1u << order;
+    }
+}
+
+// Take a block of exactly 2^order frames, returns frame number or 0
+static uint32_t alloc_order(uint32_t order) {
+    uint32_t mask = free_order_mask & ~((1u << order) - 1);
+    if (mask == 0) {
+        return 0;
+    }
+
+    // Smallest non-empty order that is large enough
+    uint32_t k = __builtin_ctz(mask);
+    struct free_block* block = free_lists[k];
+    uint32_t frame = block_to_frame(block);
+    list_remove(block, k);
+
+    // Split, returning upper halves to the free lists
+    while (k > order) {
+        k--;
+        list_push(frame + (1u << k), k);
+    }
+
+    return frame;
+}
+
+// Add a usable region, skipping anything overlapping a reserved range
+static void add_region(uint32_t start, uint32_t end, uint32_t first_reserved) {
+    for (uint32_t i = first_reserved; i < reserved_count; i++) {
+        const struct phys_range* r = &reserved[i];
+        if (r->start_frame < end && r->end_frame > start) {
+            if (start < r->start_frame) {
+                add_region(start, r->start_frame, i + 1);
+            }
+            if (r->end_frame < end) {
+                add_region(r->end_frame, end, i + 1);
+            }
+            return;
+        }
+    }
+
+    if (end > start) {
+        stats.total_frames += end - start;
+        stats.free_frames += end - start;
+        if (end > stats.end_frame) {
+            stats.end_frame = end;
+        }
+        free_range(start, end - start);
+    }
+}
+
+// Record a reserved physical byte range [start, end)
+static void reserve(uint32_t start, uint32_t end) {
+    if (reserved_count < PMM_MAX_RESERVED) {
+        reserved[reserved_count].start_frame = start >> PAGE_SHIFT;
+        reserved[reserved_count].end_frame = (end + PAGE_SIZE - 1) >> PAGE_SHIFT;
+        reserved_count++;
+    }
+}
+
+// Add a usable byte range reported by the bootloader, clipped to the direct map
+static void add_usable(uint64_t base, uint64_t length) {
+    uint64_t end = base + length;
+    uint64_t limit = (uint64_t)PMM_MAX_FRAMES << PAGE_SHIFT;
+
+    if (base >= limit) {
+        return;
+    }
+    if (end > limit) {
+        end = limit;
+    }
+
+    // Only whole frames are usable
+    uint32_t start_frame = (uint32_t)((base + PAGE_SIZE - 1) >> PAGE_SHIFT);
+    uint32_t end_frame = (uint32_t)(end >> PAGE_SHIFT);
+    if (end_frame > start_frame) {
+        add_region(start_frame, end_frame, 0);
+    }
+}
+
+// Initialize allocator from the Multiboot memory map
+void pmm_init(uint32_t magic, uint32_t mbi_phys) {
+    memset(&stats, 0, sizeof(stats));
+
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || mbi_phys == 0) {
+        return;
+    }
+    const struct multiboot_info* mbi = (const struct multiboot_info*)PHYS_TO_VIRT(mbi_phys);
+
+    // Low memory (BIOS data, VGA, option ROMs), kernel image, boot stack and boot info
+    reserve(0, 0x100000);
+    reserve(VIRT_TO_PHYS(_kernel_start), VIRT_TO_PHYS(_kernel_end));
+    reserve(VIRT_TO_PHYS(boot_stack_guard), VIRT_TO_PHYS(boot_stack_top));
+    reserve(mbi_phys, mbi_phys + sizeof(struct multiboot_info));
+
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+        reserve(mbi->mmap_addr, mbi->mmap_addr + mbi->mmap_length);
+
+        uint32_t addr = PHYS_TO_VIRT(mbi->mmap_addr);
+        uint32_t end = addr + mbi->mmap_length;
+        while (addr < end) {
+            const struct multiboot_mmap_entry* entry = (const struct multiboot_mmap_entry*)addr;
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                uint64_t base = ((uint64_t)entry->base_high << 32) | entry->base_low;
+                uint64_t length = ((uint64_t)entry->length_high << 32) | entry->length_low;
+                add_usable(base, length);
+            }
+            addr += entry->size + sizeof(entry->size);
+        }
+    } else if (mbi->flags & MULTIBOOT_INFO_MEMORY) {
+        // No map: assume mem_upper KiB of contiguous memory from 1 MiB
+        add_usable(0x100000, (uint64_t)mbi->mem_upper * 1024);
+    }
+}
+
+// Allocate one frame
+uint32_t pmm_alloc_frame(void) {
+    return pmm_alloc_frames(1);
+}
+
+// Allocate count physically contiguous frames
+uint32_t pmm_alloc_frames(uint32_t count) {
+    // The free lists are shared with interrupt-time callers and other CPUs
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    if (count == 0 || count > (1u << PMM_MAX_ORDER)) {
+        stats.failed_count++;
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        return 0;
+    }
+
+    // Round up to a power of two
+    uint32_t order = 0;
+    while ((1u << order) < count) {
+        order++;
+    }
+
+    uint32_t frame = alloc_order(order);
+    if (frame == 0) {
+        stats.failed_count++;
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        return 0;
+    }
+
+    // Give back the unused tail of the block
+    if ((1u << order) > count) {
+        free_range(frame + count, (1u << order) - count);
+    }
+
+    stats.free_frames -= count;
+    stats.alloc_count++;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return frame << PAGE_SHIFT;
+}
+
+// Free one frame
+void pmm_free_frame(uint32_t addr) {
+    pmm_free_frames(addr, 1);
+}
+
+// Free count contiguous frames starting at addr
+void pmm_free_frames(uint32_t addr, uint32_t count) {
+    uint32_t frame = addr >> PAGE_SHIFT;
+    if (frame == 0 || frame + count > PMM_MAX_FRAMES) {
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    free_range(frame, count);
+    stats.free_frames += count;
+    stats.free_count++;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+// Snapshot of allocator statistics (consistent: taken under the lock)
+void pmm_get_stats(struct pmm_stats* out) {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    memcpy(out, &stats, sizeof(stats));
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
@@ -1,11 +1,52 @@
 #include "include/print.h"
 #include "include/port_io.h"
+#include "include/spinlock.h"
+#include "include/softirq.h"
+#include "include/serial.h"
+#include "include/timer_wheel.h"
+#include "include/cpu.h"
 
-// Terminal state
+// Terminal state. Every CPU and the keyboard softirq print, so the public
+// entry points hold terminal_lock (a ticket lock: a CPU printing a lot cannot
+// starve the others); the static helpers below expect it held. IRQ handlers
+// do not print, so holding it only needs softirqs off, and a scroll never
+// delays an interrupt. The exception panic path does print, possibly while
+// this CPU or another holds the lock, so it calls terminal_panic first and
+// from then on output skips the lock and goes straight to the screen.
+static LOCK_CLASS(terminal_class, "terminal");
+static struct ticket_lock terminal_lock = TICKET_LOCK_INIT(&terminal_class);
 static uint8_t terminal_row;
 static uint8_t terminal_column;
 static uint8_t terminal_color;
-static uint16_t* terminal_buffer;
+
+// Scrollback: the console is a ring of SCROLLBACK_LINES lines in normal RAM,
+// and the screen shows VGA_HEIGHT consecutive ones starting at top (a
+// free-running line number). A new line at the bottom advances top and
+// blanks the line it reuses, so scrolling costs the same however much has
+// been printed. view lines back from the live screen, Shift+PageUp/PageDown
+// page through what scrolled off; new output returns to the live screen.
+//
+// Rows of the screen are marked dirty as they change. flush copies the
+// dirty rows of the current view to VGA memory (uncached, and far slower to
+// touch) and moves the hardware cursor, once per batch: when a write ends in
+// a completed line, on terminal_flush, and otherwise from a timer on the
+// next tick. A scroll dirties every row, so scrolling output always waits
+// for the timer: a burst of lines redraws the screen once per tick, not
+// once per line.
+static uint16_t history[SCROLLBACK_LINES][VGA_WIDTH] __attribute__((aligned(4)));
+static uint32_t top;                // Line at screen row 0 of the live screen
+static uint32_t oldest;             // Oldest line still in the ring
+static uint32_t view;               // Lines scrolled back, 0 when live
+static uint32_t dirty_rows;         // Bit per row changed since the last flush
+static int cursor_moved;
+static int flush_now;               // A newline that did not scroll was written
+static volatile int panicking;      // Set by terminal_panic: no lock, no batching
+
+static struct timer flush_timer;
+static void flush_deferred(void* arg);
+static struct tasklet flush_tasklet = TASKLET_INIT(flush_deferred, 0);
+
+#define ALL_ROWS ((1u << VGA_HEIGHT) - 1)
 
 // VGA cursor control ports
 #define VGA_CTRL_REGISTER 0x3D4
@@ -24,61 +65,128 @@ static void update_cursor(uint8_t x, uint8_t y) {
     outb(VGA_DATA_REGISTER, (uint8_t)((pos >> 8) & 0xFF));
 }
 
-// Initialize terminal
-void terminal_initialize(void) {
-    terminal_row = 0;
-    terminal_column = 0;
-    terminal_color = vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
-    terminal_buffer = (uint16_t*)VGA_MEMORY;
+static inline uint16_t* line(uint32_t n) {
+    return history[n & (SCROLLBACK_LINES - 1)];
+}
 
-    // Clear screen
-    terminal_clear();
+static void blank_line(uint32_t n) {
+    const uint32_t blank = vga_entry(' ', terminal_color) * 0x00010001u;
+    uint32_t* cells = (uint32_t*)line(n);
+    for (uint32_t i = 0; i < VGA_WIDTH / 2; i++) {
+        cells[i] = blank;
+    }
 }
 
-// Clear entire screen
-void terminal_clear(void) {
-    for (uint8_t y = 0; y < VGA_HEIGHT; y++) {
-        for (uint8_t x = 0; x < VGA_WIDTH; x++) {
-            const uint32_t index = y * VGA_WIDTH + x;
-            terminal_buffer[index] = vga_entry(' ', terminal_color);
+// Copy the dirty rows of the view to the screen, two cells per store
+static void flush(void) {
+    volatile uint32_t* vga = (volatile uint32_t*)VGA_MEMORY;
+
+    uint32_t rows = dirty_rows;
+    dirty_rows = 0;
+    while (rows) {
+        uint32_t y = bsf(rows);
+        rows &= rows - 1;
+        const uint32_t* src = (const uint32_t*)line(top - view + y);
+        volatile uint32_t* dst = vga + y * (VGA_WIDTH / 2);
+        for (uint32_t i = 0; i < VGA_WIDTH / 2; i++) {
+            dst[i] = src[i];
         }
     }
-    terminal_row = 0;
-    terminal_column = 0;
-    update_cursor(terminal_column, terminal_row);
+
+    // Off the screen (hidden) while looking at history
+    if (cursor_moved) {
+        if (view) {
+            update_cursor(0, VGA_HEIGHT);
+        } else {
+            update_cursor(terminal_column, terminal_row);
+        }
+        cursor_moved = 0;
+    }
+    flush_now = 0;
 }
 
-// Set text color
-void terminal_setcolor(uint8_t color) {
-    terminal_color = color;
+static void lock_terminal(void) {
+    if (panicking) {
+        return;
+    }
+    local_bh_disable();
+    ticket_lock(&terminal_lock);
 }
 
-// Put character at specific position
-void terminal_putentryat(char c, uint8_t color, uint8_t x, uint8_t y) {
-    const uint32_t index = y * VGA_WIDTH + x;
-    terminal_buffer[index] = vga_entry(c, color);
+// Flush a finished line now; leave anything else to the next tick
+static void unlock_terminal(void) {
+    if (panicking) {
+        flush();
+        return;
+    }
+    if (flush_now) {
+        flush();
+    } else if ((dirty_rows || cursor_moved) && !timer_pending(&flush_timer)) {
+        timer_add(&flush_timer, 1);
+    }
+    ticket_unlock(&terminal_lock);
+    local_bh_enable();
 }
 
-// Scroll screen up by one line
-void terminal_scroll(void) {
-    // Move all lines up by one
-    for (uint8_t y = 0; y < VGA_HEIGHT - 1; y++) {
-        for (uint8_t x = 0; x < VGA_WIDTH; x++) {
-            uint32_t src_index = (y + 1) * VGA_WIDTH + x;
-            uint32_t dst_index = y * VGA_WIDTH + x;
-            terminal_buffer[dst_index] = terminal_buffer[src_index];
-        }
+// Tasklet behind flush_timer
+static void flush_deferred(void* arg) {
+    (void)arg;
+    lock_terminal();
+    flush();
+    unlock_terminal();
+}
+
+// Timer callback (interrupts disabled): leave the copying to the tasklet
+static void flush_tick(void* arg) {
+    (void)arg;
+    tasklet_schedule(&flush_tasklet);
+}
+
+// Show the view lines back from the live screen (clamped to the history kept)
+static void set_view(uint32_t lines) {
+    if (lines > top - oldest) {
+        lines = top - oldest;
     }
+    if (lines != view) {
+        view = lines;
+        dirty_rows = ALL_ROWS;
+        cursor_moved = 1;
+    }
+}
+
+static void put_entry(char c, uint8_t color, uint8_t x, uint8_t y) {
+    line(top + y)[x] = vga_entry(c, color);
+    dirty_rows |= 1u << y;
+}
 
-    // Clear last line
-    for (uint8_t x = 0; x < VGA_WIDTH; x++) {
-        uint32_t index = (VGA_HEIGHT - 1) * VGA_WIDTH + x;
-        terminal_buffer[index] = vga_entry(' ', terminal_color);
+// Start a fresh screen below the current output (which stays in history)
+static void clear(void) {
+    top += terminal_row + (terminal_column ? 1 : 0);
+    for (uint32_t y = 0; y < VGA_HEIGHT; y++) {
+        blank_line(top + y);
+    }
+    if (top + VGA_HEIGHT - oldest > SCROLLBACK_LINES) {
+        oldest = top + VGA_HEIGHT - SCROLLBACK_LINES;
     }
+    terminal_row = 0;
+    terminal_column = 0;
+    view = 0;
+    dirty_rows = ALL_ROWS;
+    cursor_moved = 1;
 }
 
-// Handle backspace
-void terminal_backspace(void) {
+// New line at the bottom: advance top, reusing the oldest line
+static void scroll(void) {
+    top++;
+    blank_line(top + VGA_HEIGHT - 1);
+    if (top + VGA_HEIGHT - oldest > SCROLLBACK_LINES) {
+        oldest++;
+    }
+    dirty_rows = ALL_ROWS;
+    flush_now = 0;
+}
+
+static void backspace(void) {
     if (terminal_column > 0) {
         terminal_column--;
     } else if (terminal_row > 0) {
@@ -87,18 +195,21 @@ void terminal_backspace(void) {
     }
 
     // Clear character at current position
-    terminal_putentryat(' ', terminal_color, terminal_column, terminal_row);
-    update_cursor(terminal_column, terminal_row);
+    put_entry(' ', terminal_color, terminal_column, terminal_row);
+    cursor_moved = 1;
+    serial_putc('\b');
 }
 
-// Put character at current cursor position
-void terminal_putchar(char c) {
+static void put_char(char c) {
+    set_view(0);
+
     // Handle special characters
     if (c == '\n') {
         // Newline
         terminal_column = 0;
+        flush_now = 1;
         if (++terminal_row >= VGA_HEIGHT) {
-            terminal_scroll();
+            scroll();
             terminal_row = VGA_HEIGHT - 1;
         }
     } else if (c == '\r') {
@@ -107,47 +218,129 @@ void terminal_putchar(char c) {
     } else if (c == '\t') {
         // Tab (4 spaces)
         for (int i = 0; i < 4; i++) {
-            terminal_putchar(' ');
+            put_char(' ');
         }
-        return;  // Cursor already updated by recursive calls
+        return;  // Cursor already moved by recursive calls
     } else if (c == '\b') {
         // Backspace
-        terminal_backspace();
+        backspace();
         return;
     } else {
         // Regular character
-        terminal_putentryat(c, terminal_color, terminal_column, terminal_row);
+        put_entry(c, terminal_color, terminal_column, terminal_row);
 
         if (++terminal_column >= VGA_WIDTH) {
             terminal_column = 0;
             if (++terminal_row >= VGA_HEIGHT) {
-                terminal_scroll();
+                scroll();
                 terminal_row = VGA_HEIGHT - 1;
             }
         }
     }
 
-    update_cursor(terminal_column, terminal_row);
+    cursor_moved = 1;
+    serial_putc(c);
+}
+
+// Initialize terminal (before gdt_init, so without the lock)
+void terminal_initialize(void) {
+    terminal_row = 0;
+    terminal_column = 0;
+    terminal_color = vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
+    timer_setup(&flush_timer, flush_tick, 0);
+
+    // Clear screen
+    clear();
+    flush();
+}
+
+void terminal_panic(void) {
+    asm volatile("cli");
+    panicking = 1;
+    set_view(0);
+}
+
+// Push pending output to the screen now
+void terminal_flush(void) {
+    lock_terminal();
+    flush();
+    unlock_terminal();
+}
+
+// Clear entire screen
+void terminal_clear(void) {
+    lock_terminal();
+    clear();
+    unlock_terminal();
+}
+
+// Set text color
+void terminal_setcolor(uint8_t color) {
+    terminal_color = color;
+}
+
+// Put character at specific position
+void terminal_putentryat(char c, uint8_t color, uint8_t x, uint8_t y) {
+    lock_terminal();
+    put_entry(c, color, x, y);
+    unlock_terminal();
+}
+
+// Scroll screen up by one line
+void terminal_scroll(void) {
+    lock_terminal();
+    scroll();
+    unlock_terminal();
+}
+
+// Move the view through the scrollback, lines > 0 towards older output
+void terminal_scrollback(int32_t lines) {
+    lock_terminal();
+    if (lines < 0) {
+        set_view((uint32_t)-lines < view ? view + lines : 0);
+    } else {
+        set_view(view + lines);
+    }
+    flush();
+    unlock_terminal();
+}
+
+// Handle backspace
+void terminal_backspace(void) {
+    lock_terminal();
+    set_view(0);
+    backspace();
+    unlock_terminal();
 }
 
-// Write data of specific size
+// Put character at current cursor position
+void terminal_putchar(char c) {
+    lock_terminal();
+    put_char(c);
+    unlock_terminal();
+}
+
+// Write data of specific size (in one piece, not interleaved with other CPUs)
 void terminal_write(const char* data, uint32_t size) {
+    lock_terminal();
     for (uint32_t i = 0; i < size; i++) {
-        terminal_putchar(data[i]);
+        put_char(data[i]);
     }
+    unlock_terminal();
 }
 
 // Write null-terminated string
 void terminal_writestring(const char* data) {
+    lock_terminal();
     uint32_t i = 0;
     while (data[i] != '\0') {
-        terminal_putchar(data[i]);
+        put_char(data[i]);
         i++;
     }
+    unlock_terminal();
 }
 
 // Legacy function for backward compatibility
 void print_string(const char *str) {
     terminal_writestring(str);
 }
-
@@ -0,0 +1,205 @@
+#include "include/profile.h"
+#include "include/ksyms.h"
+#include "include/percpu.h"
+#include "include/idt.h"
+#include "include/apic.h"
+#include "include/cpu.h"
+#include "include/heap.h"
+#include "include/string.h"
+#include "include/atomic.h"
+
+// Sampling profiler
+//
+// Each sample is the EIP the timer interrupt found in irq_regs, resolved to
+// its function with a binary search of the kernel symbol table and counted
+// in the interrupted CPU's own row of the histogram, so CPUs never share a
+// counter. The last column of a row counts EIPs outside the kernel's code.
+//
+// At the base rate the scheduler tick takes the sample. For a higher rate
+// every CPU runs its LAPIC timer multiplier times faster: an application
+// processor, whose tick is the LAPIC timer, keeps only every multiplier-th
+// interrupt as a tick; the boot CPU ticks from the PIT and starts its LAPIC
+// timer for the samples alone. Each CPU reprograms its own timer at its next
+// tick after the rate changes.
+//
+// Code running with interrupts disabled is never sampled, and with tickless
+// idle an idle CPU takes no base-rate samples.
+
+struct profile_cpu {
+    uint32_t multiplier;      // Rate this CPU's timer is set for
+    uint32_t subticks;        // LAPIC interrupts since the last tick
+    uint32_t samples;
+    volatile uint32_t in_sample;  // Between the active check and the count
+} __attribute__((aligned(64)));
+
+static uint32_t* histogram;   // MAX_CPUS rows of columns counters
+static uint32_t columns;      // Symbols, plus one for outside the kernel
+static volatile uint32_t active = 0;
+static volatile uint32_t multiplier = 1;
+static struct profile_cpu profile_cpus[MAX_CPUS] = { [0 ... MAX_CPUS - 1] = { .multiplier = 1 } };
+
+static void sample(uint32_t cpu) {
+    struct registers* regs = cpu_data[cpu].irq_regs;
+    struct profile_cpu* pc = &profile_cpus[cpu];
+    if (regs == 0) {
+        return;
+    }
+
+    // Locked, so the active check cannot move ahead of it; profile_start
+    // waits for in_sample to drop before it clears the histogram
+    atomic_xchg(&pc->in_sample, 1);
+    if (active) {
+        int32_t index = ksym_index(regs->eip);
+        if (index < 0) {
+            index = columns - 1;
+        }
+        histogram[cpu * columns + index]++;
+        pc->samples++;
+    }
+    smp_release();
+    pc->in_sample = 0;
+}
+
+// Program this CPU's timer for the current multiplier (interrupts disabled).
+// Without a LAPIC timer the CPU stays at the base rate.
+static void sync_rate(uint32_t cpu) {
+    struct profile_cpu* pc = &profile_cpus[cpu];
+    uint32_t wanted = multiplier;
+    if (pc->multiplier == wanted) {
+        return;
+    }
+
+    // Back at the base rate the boot CPU's LAPIC timer has nothing to do
+    int ok = lapic_timer_set_rate(wanted == 1 && cpu == 0 ? 0 : wanted);
+    pc->multiplier = ok ? wanted : 1;
+    pc->subticks = 0;
+}
+
+void profile_tick(void) {
+    uint32_t cpu = this_cpu()->index;
+    sync_rate(cpu);
+    if (profile_cpus[cpu].multiplier == 1) {
+        sample(cpu);
+    }
+}
+
+int profile_lapic_tick(void) {
+    uint32_t cpu = this_cpu()->index;
+    struct profile_cpu* pc = &profile_cpus[cpu];
+    if (pc->multiplier == 1) {
+        return cpu != 0;
+    }
+
+    sample(cpu);
+    if (cpu == 0 || ++pc->subticks < pc->multiplier) {
+        return 0;
+    }
+    pc->subticks = 0;
+    return 1;
+}
+
+int profile_lapic_busy(void) {
+    return profile_cpus[this_cpu()->index].multiplier != 1;
+}
+
+uint32_t profile_start(uint32_t rate) {
+    if (ksym_total() == 0) {
+        return 0;
+    }
+    if (histogram == 0) {
+        columns = ksym_total() + 1;
+        histogram = kmalloc(MAX_CPUS * columns * sizeof(uint32_t));
+        if (histogram == 0) {
+            return 0;
+        }
+    }
+
+    // Let samples already past the active check land before clearing
+    atomic_xchg(&active, 0);
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        while (profile_cpus[i].in_sample) {
+            cpu_relax();
+        }
+    }
+    memset(histogram, 0, MAX_CPUS * columns * sizeof(uint32_t));
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        profile_cpus[i].samples = 0;
+    }
+
+    if (rate < 1) {
+        rate = 1;
+    } else if (rate > PROFILE_MAX_MULTIPLIER) {
+        rate = PROFILE_MAX_MULTIPLIER;
+    }
+
+    // Switch this CPU now; if its timer cannot run faster, neither can the others
+    uint32_t flags = irq_save();
+    uint32_t cpu = this_cpu()->index;
+    multiplier = rate;
+    sync_rate(cpu);
+    if (profile_cpus[cpu].multiplier != rate) {
+        rate = 1;
+        multiplier = 1;
+        sync_rate(cpu);
+    }
+    irq_restore(flags);
+
+    active = 1;
+    return rate;
+}
+
+void profile_stop(void) {
+    active = 0;
+
+    uint32_t flags = irq_save();
+    multiplier = 1;
+    sync_rate(this_cpu()->index);
+    irq_restore(flags);
+}
+
+uint32_t profile_top(struct profile_entry* out, uint32_t max) {
+    if (histogram == 0) {
+        return 0;
+    }
+    uint32_t* totals = kzalloc(columns * sizeof(uint32_t));
+    if (totals == 0) {
+        return 0;
+    }
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        const uint32_t* row = &histogram[cpu * columns];
+        for (uint32_t i = 0; i < columns; i++) {
+            totals[i] += row[i];
+        }
+    }
+
+    // Pick the largest remaining column max times (max is small)
+    uint32_t count = 0;
+    while (count < max) {
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < columns; i++) {
+            if (totals[i] > totals[best]) {
+                best = i;
+            }
+        }
+        if (totals[best] == 0) {
+            break;
+        }
+        out[count].name = best < columns - 1 ? ksym_name(best) : 0;
+        out[count].samples = totals[best];
+        totals[best] = 0;
+        count++;
+    }
+
+    kfree(totals);
+    return count;
+}
+
+void profile_get_stats(struct profile_stats* out) {
+    out->active = active;
+    out->multiplier = multiplier;
+    out->samples = 0;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        out->samples += profile_cpus[i].samples;
+    }
+}
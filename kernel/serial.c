@@ -0,0 +1,206 @@
+#include "include/serial.h"
+#include "include/port_io.h"
+#include "include/idt.h"
+#include "include/cpu.h"
+#include "include/spinlock.h"
+#include "include/softirq.h"
+#include "include/ring.h"
+#include "include/keyboard.h"
+#include "include/klog.h"
+
+// Serial console on COM1
+//
+// The terminal mirrors its output here. Characters go into a transmit ring
+// and the UART's 16-byte FIFO is refilled a burst at a time: when a burst
+// drains the UART raises the THRE interrupt and the handler loads the next
+// one, so the writer never polls the line status per byte. The THRE
+// interrupt is only enabled while the ring has data. Before interrupts are
+// set up, and when the ring is full, the writer refills the FIFO itself.
+//
+// Received bytes are queued by the IRQ handler and handed to the keyboard
+// input path from a softirq, so the shell reads both alike.
+
+static int present = 0;
+static int irq_mode = 0;
+
+static char tx_buffer[SERIAL_TX_SIZE];
+static struct char_ring tx_ring = RING_INIT(tx_buffer);
+static uint8_t rx_buffer[SERIAL_RX_SIZE];
+static struct byte_ring rx_ring = RING_INIT(rx_buffer);
+
+// Guards the UART registers and the transmit side of the ring
+static LOCK_CLASS(serial_class, "serial");
+static struct spinlock serial_lock = SPINLOCK_INIT(&serial_class);
+static volatile int tx_busy = 0;    // A burst is in the FIFO, THRE interrupt armed
+
+static struct serial_stats stats;
+
+static inline uint8_t uart_read(uint32_t reg) {
+    return inb(SERIAL_COM1 + reg);
+}
+
+static inline void uart_write(uint32_t reg, uint8_t value) {
+    outb(SERIAL_COM1 + reg, value);
+}
+
+// Load up to one FIFO's worth from the ring (serial_lock held, FIFO empty)
+static uint32_t tx_burst(void) {
+    char burst[UART_FIFO_SIZE];
+    uint32_t count = char_ring_pop_bulk(&tx_ring, burst, UART_FIFO_SIZE);
+    for (uint32_t i = 0; i < count; i++) {
+        uart_write(UART_DATA, burst[i]);
+    }
+    if (count) {
+        stats.tx_bytes += count;
+        stats.tx_bursts++;
+    }
+    return count;
+}
+
+// Start transmitting if the UART is idle. The THRE interrupt is armed even
+// when the FIFO still holds a polled burst: it fires once that drains.
+static void tx_kick(void) {
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    if (!tx_busy) {
+        if (uart_read(UART_LSR) & UART_LSR_THRE) {
+            tx_burst();
+        }
+        tx_busy = 1;
+        uart_write(UART_IER, UART_IER_RX | UART_IER_TX);
+    }
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+// Push the ring out by polling (no interrupts yet, or the ring is full)
+static void tx_poll(void) {
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    while (!(uart_read(UART_LSR) & UART_LSR_THRE)) {
+        cpu_relax();
+    }
+    tx_burst();
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+static void tx_put(char c) {
+    if (char_ring_push(&tx_ring, c)) {
+        return;
+    }
+
+    // One stall, however many polls it takes to drain room for the byte
+    stats.tx_waits++;
+    do {
+        tx_poll();
+    } while (!char_ring_push(&tx_ring, c));
+}
+
+void serial_putc(char c) {
+    if (!present) {
+        return;
+    }
+
+    if (c == '\n') {
+        tx_put('\r');
+        tx_put('\n');
+    } else if (c == '\b') {
+        tx_put('\b');
+        tx_put(' ');
+        tx_put('\b');
+    } else {
+        tx_put(c);
+    }
+
+    if (!irq_mode) {
+        while (!char_ring_empty(&tx_ring)) {
+            tx_poll();
+        }
+    } else {
+        // tx_busy must be read under the lock: the IRQ may be about to find
+        // the ring empty and disarm THRE without seeing these bytes
+        tx_kick();
+    }
+}
+
+// Hand received bytes to the keyboard input path
+static void serial_softirq(void) {
+    uint8_t bytes[16];
+    uint32_t count;
+    while ((count = byte_ring_pop_bulk(&rx_ring, bytes, sizeof(bytes))) != 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            char c = bytes[i];
+            if (c == '\r') {
+                c = '\n';
+            } else if (c == 0x7F) {
+                c = '\b';
+            }
+            keyboard_input(c);
+        }
+    }
+}
+
+static int serial_irq(void* ctx) {
+    (void)ctx;
+    if (uart_read(UART_IIR) & UART_IIR_NONE) {
+        return IRQ_NONE;
+    }
+
+    spin_lock(&serial_lock);
+    uint8_t lsr;
+    while ((lsr = uart_read(UART_LSR)) & UART_LSR_DR) {
+        byte_ring_push(&rx_ring, uart_read(UART_DATA));
+        stats.rx_bytes++;
+    }
+
+    // Burst finished: refill, or disarm THRE once the ring is empty
+    if (tx_busy && (lsr & UART_LSR_THRE) && !tx_burst()) {
+        tx_busy = 0;
+        uart_write(UART_IER, UART_IER_RX);
+    }
+    spin_unlock(&serial_lock);
+
+    if (!byte_ring_empty(&rx_ring)) {
+        softirq_raise(SOFTIRQ_SERIAL);
+    }
+    return IRQ_HANDLED;
+}
+
+int serial_init(void) {
+    uart_write(UART_IER, 0);
+    uart_write(UART_LCR, UART_LCR_DLAB);
+    uart_write(UART_DATA, SERIAL_BAUD_DIVISOR & 0xFF);
+    uart_write(UART_IER, SERIAL_BAUD_DIVISOR >> 8);
+    uart_write(UART_LCR, UART_LCR_8N1);
+    uart_write(UART_FCR, UART_FCR_ENABLE | UART_FCR_TRIGGER_14);
+
+    // A UART in loopback mode echoes what it sends; nothing there reads 0xFF
+    uart_write(UART_MCR, UART_MCR_LOOP | UART_MCR_RTS | UART_MCR_DTR);
+    uart_write(UART_DATA, 0xAE);
+    if (uart_read(UART_DATA) != 0xAE) {
+        klog(KLOG_INFO, "serial: no UART at COM1");
+        return 0;
+    }
+
+    uart_write(UART_MCR, UART_MCR_DTR | UART_MCR_RTS | UART_MCR_OUT2);
+    present = 1;
+    klog(KLOG_INFO, "serial: COM1 16550, %u baud, %u-byte FIFO", 115200 / SERIAL_BAUD_DIVISOR, UART_FIFO_SIZE);
+    return 1;
+}
+
+void serial_start_irq(void) {
+    if (!present) {
+        return;
+    }
+
+    softirq_register(SOFTIRQ_SERIAL, "serial", serial_softirq);
+    irq_register(SERIAL_IRQ, "com1", serial_irq, 0);
+
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    irq_mode = 1;
+    uart_write(UART_IER, UART_IER_RX);
+    spin_unlock_irqrestore(&serial_lock, flags);
+
+    irq_unmask(SERIAL_IRQ);
+}
+
+void serial_get_stats(struct serial_stats* out) {
+    *out = stats;
+}
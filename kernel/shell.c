@@ -1,8 +1,26 @@
 #include "include/shell.h"
 #include "include/print.h"
 #include "include/keyboard.h"
+#include "include/serial.h"
 #include "include/string.h"
 #include "include/timer.h"
+#include "include/pmm.h"
+#include "include/heap.h"
+#include "include/paging.h"
+#include "include/cpu.h"
+#include "include/thread.h"
+#include "include/bench.h"
+#include "include/kprintf.h"
+#include "include/klog.h"
+#include "include/div64.h"
+#include "include/timer_wheel.h"
+#include "include/tsc.h"
+#include "include/smp.h"
+#include "include/spinlock.h"
+#include "include/idt.h"
+#include "include/softirq.h"
+#include "include/apic.h"
+#include "include/profile.h"
 
 // Shell state
 static char command_buffer[SHELL_BUFFER_SIZE];
@@ -10,7 +28,7 @@ static uint32_t buffer_pos = 0;
 
 // Command history (optional)
 #define HISTORY_SIZE 10
-static char command_history[HISTORY_SIZE][SHELL_BUFFER_SIZE];
+static char* command_history[HISTORY_SIZE];
 static uint32_t history_pos = 0;
 static uint32_t history_count = 0;
 
@@ -45,7 +63,19 @@ static void cmd_help(void) {
     terminal_writestring("  echo <text>    - Print text to screen\n");
     terminal_writestring("  color <0-15>   - Change text color\n");
     terminal_writestring("  uptime         - Show system uptime\n");
-    terminal_writestring("  clock          - Display ticking clock\n");
+    terminal_writestring("  clock          - Display ticking clock (in the background)\n");
+    terminal_writestring("  ps             - List kernel threads\n");
+    terminal_writestring("  sched          - Show scheduler statistics\n");
+    terminal_writestring("  cpus           - List processors and their scheduler stats\n");
+    terminal_writestring("  lockstat       - Lock contention per lock class, [reset]\n");
+    terminal_writestring("  irqstat        - Interrupt and softirq counts, longest IRQ time\n");
+    terminal_writestring("  dmesg [level]  - Kernel log, [err|warn|info|debug]\n");
+    terminal_writestring("  tickless       - Tickless idle stats, [on|off]\n");
+    terminal_writestring("  bench <test>   - Micro-benchmarks: switch, parallel, timers, mem, str\n");
+    terminal_writestring("  profile <cmd>  - Sampling profiler: start [rate], stop, top\n");
+    terminal_writestring("  meminfo        - Show physical memory usage\n");
+    terminal_writestring("  heapstat       - Show kernel heap statistics\n");
+    terminal_writestring("  vmmap          - Show page table layout\n");
     terminal_writestring("  exception      - Test exception handling (CAUTION)\n");
     terminal_writestring("  about          - About MyOS\n");
     terminal_writestring("  test           - Run test commands\n");
@@ -72,11 +102,7 @@ static void cmd_color(const char* args) {
         int color = atoi(args);
         if (color >= 0 && color <= 15) {
             terminal_setcolor(vga_entry_color(color, VGA_COLOR_BLACK));
-            terminal_writestring("Color changed to ");
-            char buffer[8];
-            itoa(color, buffer, 10);
-            terminal_writestring(buffer);
-            terminal_writestring("\n");
+            kprintf("Color changed to %d\n", color);
         } else {
             terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
             terminal_writestring("Error: Color must be 0-15\n");
@@ -103,28 +129,216 @@ static void cmd_uptime(void) {
     uint32_t minutes = (seconds % 3600) / 60;
     uint32_t secs = seconds % 60;
 
-    // Display time
-    char buffer[16];
-    itoa(hours, buffer, 10);
-    terminal_writestring("  ");
-    terminal_writestring(buffer);
-    terminal_writestring(" hours, ");
+    kprintf("  %u hours, %u minutes, %u seconds\n", hours, minutes, secs);
+    kprintf("  Total ticks: %u\n", ticks);
 
-    itoa(minutes, buffer, 10);
-    terminal_writestring(buffer);
-    terminal_writestring(" minutes, ");
+    // Microsecond uptime from the TSC clocksource
+    uint32_t ns_rem;
+    uint32_t precise = (uint32_t)div_u64_rem(timer_get_ns(), 1000000000, &ns_rem);
+    kprintf("  Precise: %u.%06u seconds\n", precise, ns_rem / 1000);
 
-    itoa(secs, buffer, 10);
-    terminal_writestring(buffer);
-    terminal_writestring(" seconds\n");
+    if (tsc_get_khz()) {
+        kprintf("  TSC: %u kHz%s\n", tsc_get_khz(), tsc_is_invariant() ? " (invariant)" : "");
+    }
+}
 
-    // Display total ticks
-    terminal_writestring("  Total ticks: ");
-    itoa(ticks, buffer, 10);
-    terminal_writestring(buffer);
+// Print a labelled frame count as "<label><MiB> MiB (<frames> frames)"
+static void print_frames(const char* label, uint32_t frames) {
+    kprintf("%s%u MiB (%u frames)\n", label, frames / (1024 * 1024 / PAGE_SIZE), frames);
+}
+
+// Print a labelled counter followed by a newline
+static void print_count(const char* label, uint32_t value) {
+    kprintf("%s%u\n", label, value);
+}
+
+// Command: meminfo
+static void cmd_meminfo(void) {
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+
+    terminal_writestring("Physical memory:\n");
+    print_frames("  Total:       ", stats.total_frames);
+    print_frames("  Free:        ", stats.free_frames);
+    print_frames("  Used:        ", stats.total_frames - stats.free_frames);
+    print_count("  Allocations: ", stats.alloc_count);
+    print_count("  Frees:       ", stats.free_count);
+    print_count("  Failures:    ", stats.failed_count);
+
+    // Free buddy blocks per order (order n = 2^n contiguous frames)
+    terminal_writestring("  Free blocks by order:\n   ");
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        kprintf(" %u:%u", order, stats.free_blocks[order]);
+    }
     terminal_writestring("\n");
 }
 
+// Write a string padded with spaces to width (right-aligned if requested)
+static void print_column(const char* str, uint32_t width, int right_align) {
+    kprintf(right_align ? "%*s" : "%-*s", (int)width, str);
+}
+
+// Write a number right-aligned in a column of the given width
+static void print_number_column(uint32_t value, uint32_t width) {
+    kprintf("%*u", (int)width, value);
+}
+
+// part * 100 / whole without overflowing 32 bits
+static uint32_t percent(uint32_t part, uint32_t whole) {
+    while (part > 0x1000000) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    return whole ? (part * 100) / whole : 0;
+}
+
+// part * 100 / whole for 64-bit quantities (TSC cycles, nanoseconds)
+static uint32_t percent64(uint64_t part, uint64_t whole) {
+    while (whole > 0xFFFFFFFF || part > 0xFFFFFFFFFFFFFF) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    return whole ? (uint32_t)div_u64(part * 100, (uint32_t)whole) : 0;
+}
+
+// Command: heapstat
+static void cmd_heapstat(void) {
+    struct heap_stats heap;
+    struct kmem_cache_stats cache;
+    uint32_t bytes_in_use = 0;
+    uint32_t slab_pages = 0;
+
+    heap_get_stats(&heap);
+
+    terminal_writestring("Cache           Size  Pages   Objs  Slabs   Hit%  Frag%\n");
+    for (uint32_t i = 0; heap_get_cache_stats(i, &cache); i++) {
+        uint32_t used = cache.objects_in_use * cache.object_size;
+        uint32_t capacity = cache.slabs * cache.slab_pages * PAGE_SIZE;
+
+        print_column(cache.name, 14, 0);
+        print_number_column(cache.object_size, 6);
+        print_number_column(cache.slab_pages, 7);
+        print_number_column(cache.objects_in_use, 7);
+        print_number_column(cache.slabs, 7);
+        print_number_column(percent(cache.hits, cache.alloc_count), 7);
+        print_number_column(capacity ? 100 - percent(used, capacity) : 0, 7);
+        terminal_writestring("\n");
+
+        bytes_in_use += used;
+        slab_pages += cache.slabs * cache.slab_pages;
+    }
+
+    bytes_in_use += heap.large_pages * PAGE_SIZE;
+    print_count("Large allocations:  ", heap.large_allocs);
+    print_count("Large pages:        ", heap.large_pages);
+    print_count("Slab pages:         ", slab_pages);
+    print_count("Bytes in use:       ", bytes_in_use);
+    print_count("Failed allocations: ", heap.failed_count);
+}
+
+// Write a 32-bit value as 0x followed by 8 hex digits
+static void print_hex(uint32_t value) {
+    kprintf("0x%08X", value);
+}
+
+// Run of contiguous mappings with identical page size and flags
+struct vm_run {
+    uint32_t virt;
+    uint32_t phys;
+    uint32_t page_size;
+    uint32_t flags;
+    uint32_t count;
+};
+
+// Print one run of the page table walk
+static void vmmap_print_run(const struct vm_run* run) {
+    if (run->count == 0) {
+        return;
+    }
+
+    print_hex(run->virt);
+    terminal_writestring("-");
+    print_hex(run->virt + run->count * run->page_size - 1);
+    terminal_writestring(" -> ");
+    print_hex(run->phys);
+    print_number_column(run->count, 6);
+    terminal_writestring(run->page_size == LARGE_PAGE_SIZE ? " x 4M " : " x 4K ");
+    terminal_writestring((run->flags & PAGE_WRITE) ? " RW" : " RO");
+    if (run->flags & PAGE_USER) {
+        terminal_writestring(" U");
+    }
+    if (run->flags & PAGE_PCD) {
+        terminal_writestring(" UC");
+    }
+    if (run->flags & PAGE_GLOBAL) {
+        terminal_writestring(" G");
+    }
+    terminal_writestring("\n");
+}
+
+// Extend the current run with one mapping, or print it and start a new one
+static void vmmap_add(struct vm_run* run, uint32_t virt, uint32_t phys, uint32_t page_size, uint32_t flags) {
+    const uint32_t mask = PAGE_WRITE | PAGE_USER | PAGE_PCD | PAGE_GLOBAL;
+    uint32_t span = run->count * run->page_size;
+
+    if (run->count > 0 && run->page_size == page_size && run->flags == (flags & mask) &&
+        run->virt + span == virt && run->phys + span == phys) {
+        run->count++;
+        return;
+    }
+
+    vmmap_print_run(run);
+    run->virt = virt;
+    run->phys = phys;
+    run->page_size = page_size;
+    run->flags = flags & mask;
+    run->count = 1;
+}
+
+// Command: vmmap
+static void cmd_vmmap(void) {
+    struct vm_run run;
+    uint32_t tables = 0;
+    uint32_t large = 0;
+    uint32_t small = 0;
+
+    run.count = 0;
+
+    terminal_writestring("Paging: PSE on, PGE ");
+    terminal_writestring(paging_has_pge() ? "on" : "off");
+    terminal_writestring(", CR3 = ");
+    print_hex(read_cr3());
+    terminal_writestring("\n");
+    terminal_writestring("Virtual range              Physical     Pages       Flags\n");
+
+    for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+        uint32_t pde = paging_get_pde(i);
+        if (!(pde & PAGE_PRESENT)) {
+            continue;
+        }
+
+        if (pde & PAGE_LARGE) {
+            vmmap_add(&run, i << 22, pde & 0xFFC00000, LARGE_PAGE_SIZE, pde);
+            large++;
+            continue;
+        }
+
+        const uint32_t* table = paging_get_table(i);
+        tables++;
+        for (uint32_t j = 0; j < PAGE_TABLE_ENTRIES; j++) {
+            if (table[j] & PAGE_PRESENT) {
+                vmmap_add(&run, (i << 22) | (j << 12), table[j] & ~0xFFF, PAGE_SIZE, table[j]);
+                small++;
+            }
+        }
+    }
+    vmmap_print_run(&run);
+
+    print_count("4 MiB pages: ", large);
+    print_count("4 KiB pages: ", small);
+    print_count("Page tables: ", tables);
+}
+
 // Command: about
 static void cmd_about(void) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
@@ -135,40 +349,436 @@ static void cmd_about(void) {
     terminal_writestring("Architecture: x86 (32-bit)\n");
     terminal_writestring("Boot: Multiboot/GRUB\n");
     terminal_writestring("\nFeatures:\n");
-    terminal_writestring("  - VGA text mode driver\n");
+    terminal_writestring("  - VGA text mode driver with scrollback (Shift+PgUp/PgDn)\n");
     terminal_writestring("  - Keyboard input\n");
-    terminal_writestring("  - Interrupt handling (IDT/PIC)\n");
+    terminal_writestring("  - Serial console (16550 UART, IRQ-driven FIFO)\n");
+    terminal_writestring("  - Interrupt handling (IDT, LAPIC/IOAPIC with PIC fallback)\n");
+    terminal_writestring("  - Higher-half kernel, paging with 4 MiB global pages\n");
+    terminal_writestring("  - Physical frame allocator and kernel heap\n");
+    terminal_writestring("  - Preemptive kernel threads, O(1) MLFQ scheduler\n");
+    terminal_writestring("  - SMP with per-CPU work-stealing run queues\n");
+    terminal_writestring("  - Hierarchical timer wheel, tickless idle\n");
+    terminal_writestring("  - Timer-driven sampling profiler with kernel symbols\n");
     terminal_writestring("  - Basic shell\n\n");
 }
 
+#define CLOCK_SECONDS 10
+
+static struct timer clock_timer;
+static uint32_t clock_remaining = 0;   // Non-zero while the timer or tasklet is live
+
+// Tasklet: draw the uptime in the top-right corner, re-arm every second
+static void clock_draw(void* arg) {
+    (void)arg;
+    uint8_t color = vga_entry_color(VGA_COLOR_BLACK, VGA_COLOR_LIGHT_CYAN);
+
+    char text[24];
+    uint32_t len = ksnprintf(text, sizeof(text), " Uptime: %us ", timer_get_uptime_seconds());
+    for (uint32_t i = 0; i < len; i++) {
+        terminal_putentryat(text[i], color, VGA_WIDTH - len + i, 0);
+    }
+    terminal_flush();
+
+    uint32_t flags = irq_save();
+    if (--clock_remaining > 0) {
+        timer_add(&clock_timer, 100);  // 1 second at 100 Hz
+    }
+    irq_restore(flags);
+}
+
+static struct tasklet clock_tasklet = TASKLET_INIT(clock_draw, 0);
+
+// Timer callback (interrupts disabled): leave the drawing to the tasklet
+static void clock_tick(void* arg) {
+    (void)arg;
+    tasklet_schedule(&clock_tasklet);
+}
+
 // Command: clock
 static void cmd_clock(void) {
-    terminal_writestring("Displaying clock for 10 seconds...\n");
-    terminal_writestring("Press Ctrl+C to stop (not implemented yet)\n\n");
+    // Restart the countdown; only start the chain if it has run out, since
+    // between the timer and the tasklet it is live but not pending
+    uint32_t flags = irq_save();
+    if (clock_remaining == 0) {
+        timer_setup(&clock_timer, clock_tick, 0);
+        timer_add(&clock_timer, 0);
+    }
+    clock_remaining = CLOCK_SECONDS + 1;
+    irq_restore(flags);
+    terminal_writestring("Clock running in the top-right corner for 10 seconds.\n");
+}
+
+// Command: ps
+static void cmd_ps(void) {
+    static const char* state_names[] = { "run", "ready", "blocked", "dead" };
+    struct thread_info info;
+
+    terminal_writestring("  ID  Name              State   Pri  CPU  Switches     Ticks\n");
+    for (uint32_t i = 0; thread_get_info(i, &info); i++) {
+        print_number_column(info.id, 4);
+        terminal_writestring("  ");
+        print_column(info.name, 16, 0);
+        terminal_writestring("  ");
+        print_column(state_names[info.state], 7, 0);
+        print_number_column(info.priority, 4);
+        print_number_column(info.cpu, 5);
+        print_number_column(info.switches, 9);
+        print_number_column(info.ticks, 10);
+        terminal_writestring("\n");
+    }
+    print_count("Context switches: ", thread_context_switches());
+}
 
-    uint32_t start_tick = timer_get_ticks();
-    uint32_t last_second = 0;
+// Command: sched
+static void cmd_sched(void) {
+    struct sched_stats stats;
+    sched_get_stats(&stats);
 
-    while (timer_get_ticks() - start_tick < 1000) {  // 10 seconds at 100 Hz
-        uint32_t current_second = timer_get_uptime_seconds();
+    print_count("Context switches: ", stats.context_switches);
+    print_count("Preemptions:      ", stats.preemptions);
+    print_count("Wakeups:          ", stats.wakeups);
+    print_count("Priority boosts:  ", stats.boosts);
 
-        if (current_second != last_second) {
-            last_second = current_second;
+    terminal_writestring("Run queue lengths:");
+    for (uint32_t p = 0; p < SCHED_PRIORITIES; p++) {
+        print_number_column(stats.queue_length[p], 4);
+    }
+    terminal_writestring("\n");
 
-            // Move cursor to beginning of line (print \r)
-            terminal_writestring("\rUptime: ");
+    uint32_t average = 0;
+    if (stats.latency_samples) {
+        average = (uint32_t)div_u64(stats.latency_cycles, stats.latency_samples);
+    }
+    print_count("Avg ready-to-run latency (cycles): ", average);
+    print_count("Max ready-to-run latency (cycles): ", (uint32_t)stats.latency_max);
+    print_count("Steals:           ", stats.steals);
+    print_count("Migrations:       ", stats.migrations);
+}
 
-            char buffer[16];
-            itoa(current_second, buffer, 10);
-            terminal_writestring(buffer);
-            terminal_writestring(" seconds   ");
+// Command: cpus
+static void cmd_cpus(void) {
+    terminal_writestring("CPU  APIC  Switches  Steals  Migrations  Runnable  Idle%\n");
+    for (uint32_t i = 0; i < smp_cpu_count(); i++) {
+        struct cpu* cpu = smp_get_cpu(i);
+        struct sched_cpu_stats stats;
+        print_number_column(i, 3);
+        print_number_column(cpu->apic_id, 6);
+        if (sched_get_cpu_stats(i, &stats)) {
+            uint32_t idle = percent64(stats.idle_cycles, stats.online_cycles);
+            print_number_column(stats.context_switches, 10);
+            print_number_column(stats.steals, 8);
+            print_number_column(stats.migrations, 12);
+            print_number_column(stats.runnable, 10);
+            print_number_column(idle, 7);
+        } else {
+            terminal_writestring(cpu->online ? "  not scheduling" : "  offline");
         }
+        terminal_writestring(i == 0 ? "  (boot)\n" : "\n");
+    }
+}
+
+// Command: lockstat
+static void cmd_lockstat(const char* args) {
+    if (args && strcmp(args, "reset") == 0) {
+        lockstat_reset();
+        terminal_writestring("Lock statistics cleared.\n");
+        return;
+    } else if (args && *args) {
+        terminal_writestring("Usage: lockstat [reset]\n");
+        return;
+    }
+
+    struct lock_class_stats stats;
+    terminal_writestring("Class             Acquired  Contended  Cont%  Avg wait (cycles)\n");
+    for (uint32_t i = 0; lockstat_get(i, &stats); i++) {
+        uint32_t wait = 0;
+        if (stats.contended) {
+            wait = (uint32_t)div_u64(stats.spin_cycles, stats.contended);
+        }
+        print_column(stats.name, 16, 0);
+        print_number_column(stats.acquisitions, 10);
+        print_number_column(stats.contended, 11);
+        print_number_column(percent(stats.contended, stats.acquisitions), 7);
+        print_number_column(wait, 19);
+        terminal_writestring("\n");
+    }
+}
+
+// Command: dmesg [level] - kernel log, optionally only up to a level
+static void cmd_dmesg(const char* args) {
+    uint32_t level = KLOG_DEBUG;
+    if (args && *args) {
+        for (level = 0; klog_level_name(level); level++) {
+            if (strcmp(args, klog_level_name(level)) == 0) {
+                break;
+            }
+        }
+        if (!klog_level_name(level)) {
+            terminal_writestring("Usage: dmesg [err|warn|info|debug]\n");
+            return;
+        }
+    }
+
+    struct klog_stats stats;
+    klog_get_stats(&stats);
+    klog_dump(KLOG_RECORDS, level);
+    kprintf("%u records logged, %u kept\n", stats.logged,
+            stats.logged < KLOG_RECORDS ? stats.logged : KLOG_RECORDS);
+}
+
+// Command: irqstat
+static void cmd_irqstat(void) {
+    struct irq_stats stats;
+    terminal_writestring("Vector  IRQ       Count  Unhandled  Avg cycles  Handler\n");
+    for (uint32_t vector = IRQ_OFFSET; vector < 256; vector++) {
+        if (!irq_get_stats(vector, &stats)) {
+            continue;
+        }
+        uint32_t average = 0;
+        if (stats.count) {
+            average = (uint32_t)div_u64(stats.cycles, stats.count);
+        }
+        print_number_column(vector, 6);
+        if (vector < IRQ_OFFSET + APIC_IRQ_COUNT) {
+            print_number_column(vector - IRQ_OFFSET, 5);
+        } else {
+            print_column("-", 5, 1);
+        }
+        print_number_column(stats.count, 12);
+        print_number_column(stats.unhandled, 11);
+        print_number_column(average, 12);
+        terminal_writestring("  ");
+        terminal_writestring(stats.name ? stats.name : "(none)");
+        if (stats.handlers > 1) {
+            terminal_writestring(" +");
+            print_number_column(stats.handlers - 1, 0);
+            terminal_writestring(" shared");
+        }
+        terminal_writestring("\n");
+    }
+
+    struct softirq_stats soft;
+    terminal_writestring("Softirq           Runs  Avg cycles\n");
+    for (uint32_t nr = 0; softirq_get_stats(nr, &soft); nr++) {
+        uint32_t average = 0;
+        if (soft.runs) {
+            average = (uint32_t)div_u64(soft.cycles, soft.runs);
+        }
+        print_column(soft.name ? soft.name : "(none)", 12, 0);
+        print_number_column(soft.runs, 10);
+        print_number_column(average, 12);
+        terminal_writestring("\n");
+    }
+
+    uint64_t off = softirq_irq_off_max();
+    print_count("Longest interrupts-off time in an IRQ (cycles): ", (uint32_t)off);
+    print_count("Longest interrupts-off time in an IRQ (ns):     ", (uint32_t)tsc_to_ns(off));
+    print_count("Keyboard input dropped (buffers full):          ", keyboard_dropped());
+
+    struct serial_stats serial;
+    serial_get_stats(&serial);
+    print_count("Serial bytes sent:                              ", serial.tx_bytes);
+    print_count("Serial FIFO bursts:                             ", serial.tx_bursts);
+    print_count("Serial writer stalls (ring full):               ", serial.tx_waits);
+    print_count("Serial bytes received:                          ", serial.rx_bytes);
+}
+
+// Command: tickless
+static void cmd_tickless(const char* args) {
+    if (args && strcmp(args, "on") == 0) {
+        timer_set_tickless(1);
+    } else if (args && strcmp(args, "off") == 0) {
+        timer_set_tickless(0);
+    } else if (args && *args) {
+        terminal_writestring("Usage: tickless [on|off]\n");
+        return;
+    }
+
+    struct tickless_stats stats;
+    timer_get_tickless_stats(&stats);
+
+    terminal_writestring(timer_get_tickless() ? "Tickless idle: on\n" : "Tickless idle: off\n");
+    print_count("Ticks:              ", timer_get_ticks());
+    print_count("Idle one-shots:     ", stats.oneshots);
+    print_count("  on LAPIC timer:   ", stats.lapic_oneshots);
+    print_count("Early wakeups:      ", stats.early_wakes);
+    print_count("Avoided interrupts: ", stats.avoided);
+    print_count("AP ticks stopped:   ", stats.ap_stops);
+    print_count("AP avoided:         ", stats.ap_avoided);
+}
+
+#define PARALLEL_WORK 4000000
+
+// bench parallel: the same per-thread work with 1, 2, ... threads (one per
+// CPU at most); on idle CPUs the time stays flat as threads are added
+static void cmd_bench_parallel(void) {
+    struct bench_result result;
+    uint64_t single_ns = 0;
+
+    terminal_writestring("Threads  Time (ms)  Speedup\n");
+    for (uint32_t threads = 1; threads <= smp_cpu_count(); threads++) {
+        if (!bench_parallel(threads, PARALLEL_WORK, &result)) {
+            terminal_writestring("bench: could not start worker threads\n");
+            return;
+        }
+
+        // Speedup in hundredths: total work done relative to one thread
+        uint64_t ns = tsc_to_ns(result.cycles);
+        if (threads == 1) {
+            single_ns = ns;
+        }
+        uint32_t speedup = percent64(single_ns * threads, ns);
+
+        kprintf("%7u%11u%7u.%02u\n", threads, (uint32_t)div_u64(ns, 1000000),
+                speedup / 100, speedup % 100);
+    }
+}
+
+// Print bytes per cycle with two decimals
+static void print_bytes_per_cycle(const struct bench_result* result, uint32_t width) {
+    uint32_t hundredths = percent64(result->ops, result->cycles);
+    kprintf("%*u.%02u", (int)width - 3, hundredths / 100, hundredths % 100);
+}
+
+// bench mem: memcpy and memset throughput from 8 bytes to 1 MiB
+static void cmd_bench_mem(void) {
+    static const uint32_t sizes[] = { 8, 64, 512, 4096, 32768, 262144, 1048576 };
+    struct bench_result copy;
+    struct bench_result set;
+
+    terminal_writestring("Large copies: ");
+    terminal_writestring(string_memcpy_variant());
+    terminal_writestring("\n     Size  memcpy B/cycle  memset B/cycle\n");
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t size = sizes[i];
+        if (!bench_mem(size, &copy, &set)) {
+            terminal_writestring("bench: out of memory\n");
+            return;
+        }
+        print_number_column(size, 9);
+        print_bytes_per_cycle(&copy, 16);
+        print_bytes_per_cycle(&set, 16);
+        terminal_writestring("\n");
+    }
+}
+
+// bench str: word-at-a-time string functions against byte loops
+static void cmd_bench_str(void) {
+    static const char* names[] = { "strlen", "strcmp", "strcpy" };
+    static const uint32_t lengths[] = { 7, 32, 256, 4096 };
+    struct bench_result fast;
+    struct bench_result bytes;
+
+    terminal_writestring("Function  Length  Cycles (word)  Cycles (byte)  Speedup\n");
+    for (uint32_t op = BENCH_STRLEN; op <= BENCH_STRCPY; op++) {
+        for (uint32_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+            if (!bench_string(op, lengths[i], &fast, &bytes)) {
+                terminal_writestring("bench: out of memory\n");
+                return;
+            }
+
+            uint32_t speedup = percent64(bytes.cycles, fast.cycles);
+            kprintf("%-8s%8u%15u%15u%7u.%02u\n", names[op], lengths[i], fast.cycles_per_op,
+                    bytes.cycles_per_op, speedup / 100, speedup % 100);
+        }
+    }
+}
+
+// Command: bench
+static void cmd_bench(const char* args) {
+    struct bench_result result;
 
-        // Small delay
-        timer_sleep(10);  // Sleep for 0.1 seconds
+    if (args && strcmp(args, "switch") == 0) {
+        if (!bench_switch(10000, &result)) {
+            terminal_writestring("bench: could not start partner thread\n");
+            return;
+        }
+        print_count("Context switches: ", result.ops);
+        print_count("Cycles per switch: ", result.cycles_per_op);
+        print_count("ns per switch: ", result.ns_per_op);
+    } else if (args && strcmp(args, "parallel") == 0) {
+        cmd_bench_parallel();
+    } else if (args && strcmp(args, "mem") == 0) {
+        cmd_bench_mem();
+    } else if (args && strcmp(args, "str") == 0) {
+        cmd_bench_str();
+    } else if (args && strcmp(args, "timers") == 0) {
+        struct bench_result cancel;
+        struct timer_wheel_stats wheel;
+        if (!bench_timers(10000, &result, &cancel)) {
+            terminal_writestring("bench: out of memory\n");
+            return;
+        }
+        print_count("Timers: ", result.ops);
+        print_count("Cycles per arm: ", result.cycles_per_op);
+        print_count("Cycles per cancel: ", cancel.cycles_per_op);
+        print_count("ns per arm: ", result.ns_per_op);
+        print_count("ns per cancel: ", cancel.ns_per_op);
+
+        timer_wheel_get_stats(&wheel);
+        print_count("Pending timers: ", wheel.pending);
+        print_count("Expired timers: ", wheel.expired);
+        print_count("Cascaded timers: ", wheel.cascaded);
+    } else {
+        terminal_writestring("Usage: bench switch|parallel|timers|mem|str\n");
+    }
+}
+
+#define PROFILE_TOP 15
+
+// profile top: the functions with the most samples, all CPUs together
+static void cmd_profile_top(void) {
+    struct profile_entry top[PROFILE_TOP];
+    struct profile_stats stats;
+    profile_get_stats(&stats);
+    uint32_t count = profile_top(top, PROFILE_TOP);
+    if (count == 0) {
+        terminal_writestring("profile: no samples\n");
+        return;
+    }
+
+    terminal_writestring("  Samples       %  Function\n");
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t hundredths = percent64((uint64_t)top[i].samples * 100, stats.samples);
+        kprintf("%9u%5u.%02u  %s\n", top[i].samples, hundredths / 100, hundredths % 100,
+                top[i].name ? top[i].name : "(outside kernel text)");
     }
+    kprintf("%u samples%s\n", stats.samples, stats.active ? ", still profiling" : "");
+}
+
+// Command: profile
+static void cmd_profile(const char* args) {
+    if (args && strncmp(args, "start", 5) == 0 && (args[5] == '\0' || args[5] == ' ')) {
+        uint32_t rate = args[5] ? (uint32_t)atoi(args + 6) : 1;
+        uint32_t used = profile_start(rate);
+        if (used == 0) {
+            terminal_writestring("profile: no symbol table or out of memory\n");
+            return;
+        }
+        kprintf("Profiling every CPU at %u Hz\n", timer_get_frequency() * used);
+        if (used < rate) {
+            kprintf("(rate limited to %u per tick)\n", used);
+        }
+    } else if (args && strcmp(args, "stop") == 0) {
+        profile_stop();
+        struct profile_stats stats;
+        profile_get_stats(&stats);
+        kprintf("Profiling stopped, %u samples\n", stats.samples);
+    } else if (args && strcmp(args, "top") == 0) {
+        cmd_profile_top();
+    } else {
+        terminal_writestring("Usage: profile start [samples per tick]|stop|top\n");
+    }
+}
 
-    terminal_writestring("\n\nClock display ended.\n");
+// Recurse far deeper than the stack allows, touching each frame so it stays
+static uint32_t stack_overflow(uint32_t depth) {
+    volatile uint8_t frame[256];
+    frame[0] = (uint8_t)depth;
+    if (depth > 0x100000) {
+        return frame[0];
+    }
+    return stack_overflow(depth + 1) + frame[0];
 }
 
 // Command: exception (test exception handlers)
@@ -183,6 +793,8 @@ static void cmd_exception(const char* args) {
         terminal_writestring("  div0    - Division by zero\n");
         terminal_writestring("  gpf     - General protection fault\n");
         terminal_writestring("  invop   - Invalid opcode\n");
+        terminal_writestring("  pf      - Page fault (null pointer)\n");
+        terminal_writestring("  stack   - Kernel stack overflow (guard page)\n");
         return;
     }
 
@@ -201,6 +813,14 @@ static void cmd_exception(const char* args) {
     } else if (strcmp(args, "invop") == 0) {
         // Trigger invalid opcode using UD2 instruction
         asm volatile("ud2");
+    } else if (strcmp(args, "pf") == 0) {
+        // Trigger page fault through a null pointer (low memory is unmapped)
+        volatile uint32_t* unmapped = (volatile uint32_t*)0;
+        uint32_t value = *unmapped;
+        (void)value;
+    } else if (strcmp(args, "stack") == 0) {
+        // Trigger stack overflow by recursing until the guard page is hit
+        stack_overflow(0);
     } else {
         terminal_writestring("Unknown exception type\n");
     }
@@ -242,10 +862,18 @@ void shell_process_command(const char* cmd) {
         return;
     }
 
-    // Add to history
-    if (history_count < HISTORY_SIZE) {
-        strcpy(command_history[history_count], trimmed);
-        history_count++;
+    // Add to history, dropping the oldest entry when full
+    char* entry = kmalloc(strlen(trimmed) + 1);
+    if (entry) {
+        if (history_count == HISTORY_SIZE) {
+            kfree(command_history[0]);
+            for (uint32_t i = 1; i < HISTORY_SIZE; i++) {
+                command_history[i - 1] = command_history[i];
+            }
+            history_count--;
+        }
+        strcpy(entry, trimmed);
+        command_history[history_count++] = entry;
     }
 
     // Parse command and arguments
@@ -275,6 +903,30 @@ void shell_process_command(const char* cmd) {
         cmd_uptime();
     } else if (strcmp(trimmed, "clock") == 0) {
         cmd_clock();
+    } else if (strcmp(trimmed, "ps") == 0) {
+        cmd_ps();
+    } else if (strcmp(trimmed, "sched") == 0) {
+        cmd_sched();
+    } else if (strcmp(trimmed, "cpus") == 0) {
+        cmd_cpus();
+    } else if (strcmp(trimmed, "lockstat") == 0) {
+        cmd_lockstat(args);
+    } else if (strcmp(trimmed, "irqstat") == 0) {
+        cmd_irqstat();
+    } else if (strcmp(trimmed, "dmesg") == 0) {
+        cmd_dmesg(args);
+    } else if (strcmp(trimmed, "tickless") == 0) {
+        cmd_tickless(args);
+    } else if (strcmp(trimmed, "bench") == 0) {
+        cmd_bench(args);
+    } else if (strcmp(trimmed, "profile") == 0) {
+        cmd_profile(args);
+    } else if (strcmp(trimmed, "meminfo") == 0) {
+        cmd_meminfo();
+    } else if (strcmp(trimmed, "heapstat") == 0) {
+        cmd_heapstat();
+    } else if (strcmp(trimmed, "vmmap") == 0) {
+        cmd_vmmap();
     } else if (strcmp(trimmed, "exception") == 0) {
         cmd_exception(args);
     } else if (strcmp(trimmed, "about") == 0) {
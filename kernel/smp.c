@@ -0,0 +1,125 @@
+#include "include/smp.h"
+#include "include/acpi.h"
+#include "include/apic.h"
+#include "include/gdt.h"
+#include "include/idt.h"
+#include "include/paging.h"
+#include "include/heap.h"
+#include "include/timer.h"
+#include "include/cpu.h"
+#include "include/string.h"
+#include "include/memlayout.h"
+#include "include/thread.h"
+#include "include/klog.h"
+
+// Symmetric multiprocessing bring-up
+//
+// The boot CPU starts each application processor listed in the MADT with the
+// INIT-SIPI-SIPI sequence, one at a time, through the real-mode trampoline in
+// trampoline.s. The AP switches to the kernel page directory, loads its own
+// GDT (with its own TSSs and %fs per-CPU segment) and the shared IDT, enables
+// its LAPIC and its LAPIC timer tick, reports itself online and joins the
+// scheduler as an idle CPU that steals work from the others.
+
+struct cpu cpu_data[MAX_CPUS];
+static uint32_t cpu_count = 1;
+
+// Trampoline code and its parameter block (trampoline.s)
+extern char trampoline_start[];
+extern char trampoline_end[];
+extern uint32_t tramp_cr3;
+extern uint32_t tramp_stack;
+extern uint32_t tramp_entry;
+extern uint32_t tramp_cpu;
+
+// Address of a trampoline symbol in the copy at TRAMPOLINE_BASE
+#define TRAMPOLINE_VAR(sym) \
+    ((volatile uint32_t*)(PHYS_TO_VIRT(TRAMPOLINE_BASE) + ((char*)&(sym) - trampoline_start)))
+
+// First C code on an application processor (still on the boot page directory)
+static void __attribute__((noreturn)) ap_main(uint32_t index) {
+    string_init_cpu();
+    write_cr3(paging_get_cr3());
+    if (paging_has_pge()) {
+        write_cr4(read_cr4() | CR4_PGE);
+    }
+
+    gdt_init_cpu(index);
+    idt_load();
+    lapic_init_cpu();
+    lapic_timer_start();
+
+    this_cpu()->online = 1;
+    thread_start_cpu();
+}
+
+// INIT-SIPI-SIPI one AP and wait for it to come online
+static int start_ap(uint32_t index, uint32_t apic_id) {
+    struct cpu* cpu = &cpu_data[index];
+    cpu->apic_id = apic_id;
+    cpu->online = 0;
+    cpu->stack = kmalloc(AP_STACK_SIZE);
+    if (cpu->stack == 0) {
+        return 0;
+    }
+
+    *TRAMPOLINE_VAR(tramp_stack) = (uint32_t)(cpu->stack + AP_STACK_SIZE);
+    *TRAMPOLINE_VAR(tramp_cpu) = index;
+
+    lapic_send_ipi(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    timer_delay_us(SMP_INIT_DELAY_US);
+    for (int i = 0; i < 2 && !cpu->online; i++) {
+        lapic_send_ipi(apic_id, LAPIC_ICR_STARTUP | (TRAMPOLINE_BASE >> 12));
+        timer_delay_us(SMP_SIPI_DELAY_US);
+    }
+
+    for (uint32_t waited = 0; !cpu->online && waited < SMP_START_TIMEOUT_US; waited += 100) {
+        timer_delay_us(100);
+    }
+
+    if (!cpu->online) {
+        kfree(cpu->stack);
+        cpu->stack = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void smp_init(void) {
+    struct cpu* bsp = &cpu_data[0];
+    bsp->apic_id = lapic_get_id();
+    bsp->online = 1;
+
+    const struct acpi_madt_info* madt = acpi_get_madt();
+    if (!apic_enabled() || madt == 0) {
+        return;
+    }
+
+    // APs tick from their LAPIC timer at the PIT's rate
+    lapic_timer_calibrate(timer_get_frequency());
+
+    // The trampoline page is inside the reserved low 1 MiB, free after boot
+    memcpy((void*)PHYS_TO_VIRT(TRAMPOLINE_BASE), trampoline_start, trampoline_end - trampoline_start);
+    *TRAMPOLINE_VAR(tramp_cr3) = VIRT_TO_PHYS(boot_page_directory);
+    *TRAMPOLINE_VAR(tramp_entry) = (uint32_t)ap_main;
+
+    for (uint32_t i = 0; i < madt->cpu_count && cpu_count < MAX_CPUS; i++) {
+        if (madt->cpu_apic_ids[i] == bsp->apic_id) {
+            continue;
+        }
+        if (start_ap(cpu_count, madt->cpu_apic_ids[i])) {
+            cpu_count++;
+        } else {
+            klog(KLOG_WARN, "smp: CPU with APIC ID %u did not come online", madt->cpu_apic_ids[i]);
+        }
+    }
+    klog(KLOG_INFO, "smp: %u CPUs online", cpu_count);
+}
+
+uint32_t smp_cpu_count(void) {
+    return cpu_count;
+}
+
+struct cpu* smp_get_cpu(uint32_t index) {
+    return index < cpu_count ? &cpu_data[index] : 0;
+}
@@ -0,0 +1,174 @@
+#include "include/softirq.h"
+#include "include/cpu.h"
+#include "include/atomic.h"
+#include "include/thread.h"
+
+// Softirqs
+//
+// IRQ handlers do the minimum with interrupts disabled (read the device,
+// queue the data) and raise a softirq for the rest. When the outermost
+// interrupt returns, irq_exit runs the pending softirqs with interrupts
+// enabled, so further interrupts nest on top of them. bh_disable is held up
+// while they run: a nested interrupt then neither re-enters softirqs nor
+// preempts, so the interrupted thread cannot migrate mid-softirq.
+// Thread code sharing data with a softirq brackets it with
+// local_bh_disable/local_bh_enable, which holds off both as well.
+
+struct softirq_cpu {
+    uint32_t runs[SOFTIRQ_COUNT];
+    uint64_t cycles[SOFTIRQ_COUNT];
+    uint64_t irq_off_max;
+    struct tasklet* tasklet_head;
+    struct tasklet* tasklet_tail;
+} __attribute__((aligned(64)));
+
+static void tasklet_action(void);
+
+// Tasklets ride on a softirq of their own
+static void (*handlers[SOFTIRQ_COUNT])(void) = { [SOFTIRQ_TASKLET] = tasklet_action };
+static const char* names[SOFTIRQ_COUNT] = { [SOFTIRQ_TASKLET] = "tasklet" };
+static struct softirq_cpu softirq_cpus[MAX_CPUS];
+
+void softirq_register(enum softirq_nr nr, const char* name, void (*handler)(void)) {
+    names[nr] = name;
+    handlers[nr] = handler;
+}
+
+void softirq_raise(enum softirq_nr nr) {
+    this_cpu()->softirq_pending |= 1u << nr;
+}
+
+void tasklet_schedule(struct tasklet* t) {
+    if (atomic_xchg(&t->scheduled, 1)) {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    struct softirq_cpu* sc = &softirq_cpus[this_cpu()->index];
+    t->next = 0;
+    if (sc->tasklet_tail) {
+        sc->tasklet_tail->next = t;
+    } else {
+        sc->tasklet_head = t;
+    }
+    sc->tasklet_tail = t;
+    softirq_raise(SOFTIRQ_TASKLET);
+    irq_restore(flags);
+}
+
+// Run this CPU's queued tasklets
+static void tasklet_action(void) {
+    uint32_t flags = irq_save();
+    struct softirq_cpu* sc = &softirq_cpus[this_cpu()->index];
+    struct tasklet* t = sc->tasklet_head;
+    sc->tasklet_head = 0;
+    sc->tasklet_tail = 0;
+    irq_restore(flags);
+
+    while (t) {
+        struct tasklet* next = t->next;
+        // Cleared first, so the function may schedule it again
+        t->scheduled = 0;
+        barrier();
+        t->func(t->arg);
+        t = next;
+    }
+}
+
+static void record_irq_off(struct softirq_cpu* sc, uint64_t entry_tsc) {
+    uint64_t off = rdtsc() - entry_tsc;
+    if (off > sc->irq_off_max) {
+        sc->irq_off_max = off;
+    }
+}
+
+// Run pending softirqs (interrupts disabled on entry and on return). A
+// non-zero entry_tsc is the start of the hard interrupt being finished.
+static void do_softirq(struct cpu* cpu, uint64_t entry_tsc) {
+    struct softirq_cpu* sc = &softirq_cpus[cpu->index];
+
+    cpu->bh_disable++;
+    for (uint32_t round = 0; round < SOFTIRQ_MAX_RESTART && cpu->softirq_pending; round++) {
+        uint32_t pending = cpu->softirq_pending;
+        cpu->softirq_pending = 0;
+
+        if (entry_tsc) {
+            record_irq_off(sc, entry_tsc);
+            entry_tsc = 0;
+        }
+        asm volatile("sti" : : : "memory");
+
+        while (pending) {
+            uint32_t nr = bsf(pending);
+            pending &= pending - 1;
+
+            if (handlers[nr] == 0) {
+                continue;
+            }
+            uint64_t start = rdtsc();
+            handlers[nr]();
+            sc->cycles[nr] += rdtsc() - start;
+            sc->runs[nr]++;
+        }
+
+        asm volatile("cli" : : : "memory");
+    }
+    cpu->bh_disable--;
+}
+
+void irq_exit(uint64_t entry_tsc) {
+    struct cpu* cpu = this_cpu();
+
+    // Nested in a softirq or a bh-disabled section: the outer level finishes up
+    if (cpu->bh_disable) {
+        record_irq_off(&softirq_cpus[cpu->index], entry_tsc);
+        return;
+    }
+
+    if (cpu->softirq_pending) {
+        do_softirq(cpu, entry_tsc);
+    } else {
+        record_irq_off(&softirq_cpus[cpu->index], entry_tsc);
+    }
+
+    // Switch threads if the tick used up the current slice
+    thread_preempt();
+}
+
+void local_bh_enable(void) {
+    uint32_t flags = irq_save();
+    struct cpu* cpu = this_cpu();
+    if (--cpu->bh_disable == 0 && (flags & EFLAGS_IF)) {
+        // Catch up on what interrupts raised or asked for meanwhile
+        if (cpu->softirq_pending) {
+            do_softirq(cpu, 0);
+        }
+        thread_preempt();
+    }
+    irq_restore(flags);
+}
+
+int softirq_get_stats(uint32_t nr, struct softirq_stats* out) {
+    if (nr >= SOFTIRQ_COUNT) {
+        return 0;
+    }
+
+    out->name = names[nr];
+    out->runs = 0;
+    out->cycles = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        out->runs += softirq_cpus[cpu].runs[nr];
+        out->cycles += softirq_cpus[cpu].cycles[nr];
+    }
+    return 1;
+}
+
+uint64_t softirq_irq_off_max(void) {
+    uint64_t max = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (softirq_cpus[cpu].irq_off_max > max) {
+            max = softirq_cpus[cpu].irq_off_max;
+        }
+    }
+    return max;
+}
@@ -0,0 +1,119 @@
+#include "include/spinlock.h"
+#include "include/cpu.h"
+
+// Lock slow paths and lock class statistics
+//
+// The inline fast paths in spinlock.h only come here when the lock was
+// taken. Waiting is timed with the TSC and charged to the lock's class on
+// the waiting CPU. Classes are pushed onto a lock-free list on their first
+// acquisition, so they need no init call and registering one never takes a
+// lock itself.
+
+static struct lock_class* volatile classes = 0;
+
+void lock_class_register(struct lock_class* class) {
+    if (atomic_cmpxchg(&class->registered, 0, 1) != 0) {
+        return;
+    }
+
+    uint32_t head;
+    do {
+        head = (uint32_t)classes;
+        class->next = (struct lock_class*)head;
+    } while (atomic_cmpxchg((volatile uint32_t*)&classes, head, (uint32_t)class) != head);
+}
+
+void spin_lock_slow(struct spinlock* lock, struct lock_cpu_stats* stats) {
+    uint64_t start = rdtsc();
+    do {
+        while (lock->locked) {
+            cpu_relax();
+        }
+    } while (atomic_xchg(&lock->locked, 1));
+
+    stats->contended++;
+    stats->spin_cycles += rdtsc() - start;
+}
+
+void ticket_lock_slow(struct ticket_lock* lock, uint32_t ticket, struct lock_cpu_stats* stats) {
+    uint64_t start = rdtsc();
+    while (lock->serving != ticket) {
+        cpu_relax();
+    }
+    barrier();
+
+    stats->contended++;
+    stats->spin_cycles += rdtsc() - start;
+}
+
+void read_lock_slow(struct rwlock* lock, struct lock_cpu_stats* stats) {
+    uint64_t start = rdtsc();
+    for (;;) {
+        uint32_t value = lock->value;
+        if (value & (RWLOCK_WRITER | RWLOCK_WAITING)) {
+            cpu_relax();
+            continue;
+        }
+        if (atomic_cmpxchg(&lock->value, value, value + 1) == value) {
+            break;
+        }
+    }
+
+    stats->contended++;
+    stats->spin_cycles += rdtsc() - start;
+}
+
+void write_lock_slow(struct rwlock* lock, struct lock_cpu_stats* stats) {
+    uint64_t start = rdtsc();
+    for (;;) {
+        uint32_t value = lock->value;
+        if ((value & ~RWLOCK_WAITING) == 0) {
+            // Free: take it, clearing our (or another writer's) waiting bit.
+            // A writer that loses the race sets the bit again below.
+            if (atomic_cmpxchg(&lock->value, value, RWLOCK_WRITER) == value) {
+                break;
+            }
+            continue;
+        }
+        if (!(value & RWLOCK_WAITING)) {
+            // Hold off new readers until we get in
+            atomic_or(&lock->value, RWLOCK_WAITING);
+        }
+        cpu_relax();
+    }
+
+    stats->contended++;
+    stats->spin_cycles += rdtsc() - start;
+}
+
+int lockstat_get(uint32_t index, struct lock_class_stats* out) {
+    struct lock_class* class = classes;
+    while (class && index > 0) {
+        class = class->next;
+        index--;
+    }
+    if (class == 0) {
+        return 0;
+    }
+
+    out->name = class->name;
+    out->acquisitions = 0;
+    out->contended = 0;
+    out->spin_cycles = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        out->acquisitions += class->cpu[cpu].acquisitions;
+        out->contended += class->cpu[cpu].contended;
+        out->spin_cycles += class->cpu[cpu].spin_cycles;
+    }
+    return 1;
+}
+
+void lockstat_reset(void) {
+    for (struct lock_class* class = classes; class; class = class->next) {
+        for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+            class->cpu[cpu].acquisitions = 0;
+            class->cpu[cpu].contended = 0;
+            class->cpu[cpu].spin_cycles = 0;
+        }
+    }
+}
@@ -0,0 +1,761 @@
+#include "include/thread.h"
+#include "include/heap.h"
+#include "include/cpu.h"
+#include "include/atomic.h"
+#include "include/spinlock.h"
+#include "include/apic.h"
+#include "include/idt.h"
+#include "include/string.h"
+#include "include/softirq.h"
+#include "include/profile.h"
+#include "include/timer.h"
+
+// Preemptive kernel threads
+//
+// Every thread runs in ring 0 on its own kmalloc'd stack. A switch saves the
+// callee-saved registers on the outgoing stack and records the stack pointer
+// in the thread (switch_context in isr.s); everything else is already on the
+// stack, either from the C caller or from the interrupt stub when the switch
+// happens on IRQ exit. When nothing is ready a CPU's idle thread halts until
+// the next interrupt. A thread cannot free the stack it is running on, so
+// exited threads are parked on a zombie list and reaped after the switch.
+//
+// Scheduling is a multi-level feedback queue. A thread that uses up its slice
+// drops one level and gets a longer slice; a thread woken from blocking goes
+// back to the top and preempts anything not above it, so the shell runs as
+// soon as a key arrives. Every SCHED_BOOST_TICKS all ready threads return to
+// the top so CPU-bound ones cannot starve.
+//
+// Each CPU owns its run queues: one bounded work-stealing deque per priority
+// (after Chase and Lev) plus a ready_mask hint, so picking the next thread is
+// one bsf and no lock. Only the owner pushes, at the bottom. Threads are taken
+// from the top with a compare-and-swap, by the owner (oldest first, which
+// keeps round-robin within a level; a LIFO owner pop would starve same-level
+// threads under preemption) and by idle CPUs stealing from their peers.
+// A thread is pushed only once it is off its CPU: a preempted thread is queued
+// by whoever runs next on that CPU (finish_switch), and a waker waits for
+// on_cpu to clear. Woken and new threads go to the waker's own queues, and an
+// idle CPU gets a reschedule IPI so it can steal them. Pinned threads are
+// never stolen; waking one from another CPU goes through its home's inbox.
+
+// Save callee-saved registers and esp into *old_esp, resume the stack at new_esp
+extern void switch_context(uint32_t* old_esp, uint32_t new_esp);
+
+#define DEQUE_MASK (SCHED_DEQUE_SIZE - 1)
+
+// Bounded work-stealing deque of ready threads. Never full: it can hold
+// every thread there is (THREAD_MAX).
+struct deque {
+    volatile uint32_t top;          // Oldest thread, taken with a CAS
+    volatile uint32_t bottom;       // Next free slot, written by the owner only
+    struct thread* volatile slots[SCHED_DEQUE_SIZE];
+};
+
+// Scheduler state of one CPU (only its owner writes it, unless noted)
+struct run_queue {
+    struct deque deques[SCHED_PRIORITIES];
+    uint32_t ready_mask;            // Bit n may be set when deques[n] is non-empty
+    volatile uint32_t inbox;        // Pinned threads woken by other CPUs (any CPU pushes)
+    volatile int need_resched;      // Set by other CPUs too, with a reschedule IPI
+    struct thread* idle;
+    struct thread* prev;            // Thread being switched out, for finish_switch
+    struct thread* zombies;
+    uint32_t boost_countdown;
+    uint64_t idle_start;            // When the idle thread was last switched in
+    uint64_t idle_cycles;
+    uint64_t online_tsc;
+    struct sched_stats stats;
+} __attribute__((aligned(64)));
+
+static struct kmem_cache* thread_cache = 0;
+static struct run_queue run_queues[MAX_CPUS];
+static volatile uint32_t online_mask = 0;  // CPUs scheduling threads
+static volatile uint32_t idle_mask = 0;    // CPUs running their idle thread
+
+// Thread list, for ps and for reaping (readers only walk it)
+static LOCK_CLASS(threads_class, "threads");
+static struct rwlock threads_lock = RWLOCK_INIT(&threads_class);
+static struct thread* all_threads = 0;
+static uint32_t next_id = 0;
+static volatile uint32_t live_threads = 0;
+
+// Orders a wakeup against the thread blocking
+static LOCK_CLASS(wake_class, "wake");
+static struct spinlock wake_lock = SPINLOCK_INIT(&wake_class);
+
+static inline struct run_queue* this_rq(void) {
+    return &run_queues[this_cpu()->index];
+}
+
+static inline uint32_t slice_for(uint32_t priority) {
+    return SCHED_BASE_SLICE << (priority / 2);
+}
+
+static inline uint32_t deque_size(const struct deque* dq) {
+    int32_t size = (int32_t)(dq->bottom - dq->top);
+    return size > 0 ? (uint32_t)size : 0;
+}
+
+// Owner only
+static void deque_push(struct deque* dq, struct thread* t) {
+    uint32_t bottom = dq->bottom;
+    dq->slots[bottom & DEQUE_MASK] = t;
+    barrier();                      // x86 keeps the two stores in order
+    dq->bottom = bottom + 1;
+}
+
+// Take the oldest thread, or 0. Thieves leave pinned threads (and whatever
+// is queued behind them) alone.
+static struct thread* deque_take(struct deque* dq, int thief) {
+    while (1) {
+        uint32_t top = dq->top;
+        barrier();
+        uint32_t bottom = dq->bottom;
+        if ((int32_t)(bottom - top) <= 0) {
+            return 0;
+        }
+
+        // The slot cannot be reused while top still points at it
+        struct thread* t = dq->slots[top & DEQUE_MASK];
+        if (thief && t->pinned) {
+            return 0;
+        }
+        if (atomic_cmpxchg(&dq->top, top, top + 1) == top) {
+            return t;
+        }
+    }
+}
+
+// Whether a thief could take something from dq right now
+static int deque_stealable(const struct deque* dq) {
+    uint32_t top = dq->top;
+    barrier();
+    if ((int32_t)(dq->bottom - top) <= 0) {
+        return 0;
+    }
+    return !dq->slots[top & DEQUE_MASK]->pinned;
+}
+
+// Ask a CPU to reschedule
+static void kick_cpu(uint32_t cpu) {
+    run_queues[cpu].need_resched = 1;
+    if (cpu != this_cpu()->index) {
+        lapic_send_ipi(cpu_data[cpu].apic_id, IPI_RESCHED_VECTOR);
+    }
+}
+
+// Wake an idle CPU so it can steal work just queued here
+static void kick_idle_cpu(void) {
+    uint32_t idle = idle_mask & ~(1u << this_cpu()->index);
+    while (idle) {
+        uint32_t cpu = bsf(idle);
+        if (!run_queues[cpu].need_resched) {
+            kick_cpu(cpu);
+            return;
+        }
+        idle &= idle - 1;
+    }
+}
+
+// Queue a thread on this CPU (interrupts disabled)
+static void run_queue_push(struct run_queue* rq, struct thread* t) {
+    t->state = THREAD_READY;
+    t->ready_tsc = rdtsc();
+    deque_push(&rq->deques[t->priority], t);
+    rq->ready_mask |= 1u << t->priority;
+
+    if (!t->pinned) {
+        kick_idle_cpu();
+    }
+}
+
+// Oldest thread of the highest local priority not below max_priority, or 0
+static struct thread* run_queue_pop(struct run_queue* rq, uint32_t max_priority) {
+    uint32_t mask = rq->ready_mask & ((2u << max_priority) - 1);
+
+    while (mask) {
+        uint32_t p = bsf(mask);
+        struct thread* t = deque_take(&rq->deques[p], 0);
+        if (t) {
+            return t;
+        }
+
+        // Emptied by thieves; only the owner pushes, so the bit can go
+        rq->ready_mask &= ~(1u << p);
+        mask &= ~(1u << p);
+    }
+    return 0;
+}
+
+// Take the highest-priority stealable thread of another CPU, or 0
+static struct thread* steal(struct run_queue* rq) {
+    uint32_t self = this_cpu()->index;
+    uint32_t victims = online_mask & ~(1u << self);
+    if (victims == 0) {
+        return 0;
+    }
+
+    for (uint32_t p = 0; p < SCHED_PRIORITIES; p++) {
+        for (uint32_t i = 1; i < MAX_CPUS; i++) {
+            uint32_t victim = (self + i) % MAX_CPUS;
+            if (!(victims & (1u << victim))) {
+                continue;
+            }
+            struct thread* t = deque_take(&run_queues[victim].deques[p], 1);
+            if (t) {
+                rq->stats.steals++;
+                return t;
+            }
+        }
+    }
+    return 0;
+}
+
+// Whether another CPU has work this one could steal
+static int peers_have_work(void) {
+    uint32_t victims = online_mask & ~(1u << this_cpu()->index);
+
+    while (victims) {
+        uint32_t victim = bsf(victims);
+        victims &= victims - 1;
+        for (uint32_t p = 0; p < SCHED_PRIORITIES; p++) {
+            if (deque_stealable(&run_queues[victim].deques[p])) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Push a pinned thread woken elsewhere onto its home CPU's inbox
+static void inbox_push(struct run_queue* rq, struct thread* t) {
+    uint32_t old;
+    do {
+        old = rq->inbox;
+        t->next = (struct thread*)old;
+    } while (atomic_cmpxchg(&rq->inbox, old, (uint32_t)t) != old);
+}
+
+// Queue the threads other CPUs woke for us, oldest first
+static void drain_inbox(struct run_queue* rq) {
+    struct thread* list = (struct thread*)atomic_xchg(&rq->inbox, 0);
+    struct thread* ordered = 0;
+
+    while (list) {
+        struct thread* t = list;
+        list = t->next;
+        t->next = ordered;
+        ordered = t;
+    }
+    while (ordered) {
+        struct thread* t = ordered;
+        ordered = t->next;
+        t->next = 0;
+        run_queue_push(rq, t);
+    }
+}
+
+static int has_work(struct run_queue* rq) {
+    return rq->ready_mask || rq->inbox || rq->need_resched || peers_have_work();
+}
+
+// Move every local ready thread to the top queue, keeping their order
+static void boost_all(struct run_queue* rq) {
+    struct deque* top = &rq->deques[0];
+
+    for (uint32_t p = 1; p < SCHED_PRIORITIES; p++) {
+        struct thread* t;
+        while ((t = deque_take(&rq->deques[p], 0)) != 0) {
+            t->priority = 0;
+            deque_push(top, t);
+        }
+    }
+
+    rq->ready_mask = deque_size(top) ? 1 : 0;
+    struct thread* current = this_cpu()->current;
+    if (current != rq->idle) {
+        current->priority = 0;
+    }
+    rq->stats.boosts++;
+}
+
+// Free threads that exited on this CPU (never the one we are running on)
+static void reap_zombies(struct run_queue* rq) {
+    while (rq->zombies) {
+        struct thread* t = rq->zombies;
+        rq->zombies = t->next;
+
+        write_lock(&threads_lock);
+        struct thread** link = &all_threads;
+        while (*link && *link != t) {
+            link = &(*link)->all_next;
+        }
+        if (*link) {
+            *link = t->all_next;
+        }
+        write_unlock(&threads_lock);
+
+        kfree(t->stack);
+        kmem_cache_free(thread_cache, t);
+        atomic_add_return(&live_threads, -1u);
+    }
+}
+
+// Settle the thread we just switched away from (interrupts disabled)
+static void finish_switch(void) {
+    struct run_queue* rq = this_rq();
+    struct thread* prev = rq->prev;
+    rq->prev = 0;
+
+    // Only we change a running thread's state; a waker only moves it out of BLOCKED
+    int requeue = prev != rq->idle && prev->state == THREAD_RUNNING;
+    if (prev->state == THREAD_DEAD) {
+        prev->next = rq->zombies;
+        rq->zombies = prev;
+    }
+
+    // Its stack is saved: from here on other CPUs may run it
+    barrier();
+    prev->on_cpu = 0;
+
+    if (requeue) {
+        run_queue_push(rq, prev);
+    }
+    reap_zombies(rq);
+}
+
+// Pick the next thread and switch to it (interrupts disabled)
+static void schedule(void) {
+    struct run_queue* rq = this_rq();
+    struct cpu* cpu = this_cpu();
+    struct thread* prev = cpu->current;
+
+    if (rq->inbox) {
+        drain_inbox(rq);
+    }
+
+    // A running thread keeps the CPU unless a thread at least as urgent is queued
+    int runnable = prev->state == THREAD_RUNNING && prev != rq->idle;
+    struct thread* next = run_queue_pop(rq, runnable ? prev->priority : SCHED_PRIORITIES - 1);
+    if (next == 0 && !runnable) {
+        next = steal(rq);
+    }
+    if (next == 0) {
+        next = runnable ? prev : rq->idle;
+    }
+
+    rq->need_resched = 0;
+    next->state = THREAD_RUNNING;
+    if (next->slice_left == 0) {
+        next->slice_left = slice_for(next->priority);
+    }
+    if (next == prev) {
+        return;
+    }
+
+    uint64_t now = rdtsc();
+    if (next != rq->idle) {
+        uint64_t latency = now - next->ready_tsc;
+        rq->stats.latency_samples++;
+        rq->stats.latency_cycles += latency;
+        if (latency > rq->stats.latency_max) {
+            rq->stats.latency_max = latency;
+        }
+        if (next->cpu != cpu->index) {
+            next->cpu = cpu->index;
+            rq->stats.migrations++;
+        }
+    }
+
+    if (prev == rq->idle) {
+        rq->idle_cycles += now - rq->idle_start;
+        atomic_and(&idle_mask, ~(1u << cpu->index));
+        timer_idle_exit();
+    } else if (next == rq->idle) {
+        rq->idle_start = now;
+        atomic_or(&idle_mask, 1u << cpu->index);
+    }
+
+    next->switches++;
+    rq->stats.context_switches++;
+    next->on_cpu = 1;
+    rq->prev = prev;
+    cpu->current = next;
+    switch_context(&prev->esp, next->esp);
+
+    // Back on prev's stack, possibly much later and on another CPU
+    finish_switch();
+}
+
+// First code a new thread runs, reached by switch_context's ret
+static void thread_bootstrap(void) {
+    finish_switch();
+    asm volatile("sti");
+    struct thread* self = thread_current();
+    self->entry(self->arg);
+    thread_exit();
+}
+
+static void idle_loop(void* arg) {
+    (void)arg;
+    while (1) {
+        // Test and halt with interrupts off so a wakeup cannot slip in between
+        asm volatile("cli");
+        if (this_cpu()->softirq_pending) {
+            // Raised from thread context (a tasklet): run it before halting
+            asm volatile("sti");
+            local_bh_disable();
+            local_bh_enable();
+        } else if (has_work(this_rq())) {
+            asm volatile("sti");
+            thread_yield();
+        } else {
+            timer_idle_enter();
+            asm volatile("sti; hlt");
+        }
+    }
+}
+
+static struct thread* thread_alloc(const char* name, void (*entry)(void*), void* arg) {
+    if (atomic_add_return(&live_threads, 1) > THREAD_MAX) {
+        atomic_add_return(&live_threads, -1u);
+        return 0;
+    }
+
+    struct thread* t = kmem_cache_alloc(thread_cache);
+    if (t == 0) {
+        atomic_add_return(&live_threads, -1u);
+        return 0;
+    }
+    memset(t, 0, sizeof(*t));
+
+    if (entry) {
+        t->stack = kmalloc(THREAD_STACK_SIZE);
+        if (t->stack == 0) {
+            kmem_cache_free(thread_cache, t);
+            atomic_add_return(&live_threads, -1u);
+            return 0;
+        }
+
+        // Frame consumed by switch_context: edi, esi, ebx, ebp, return address
+        uint32_t* sp = (uint32_t*)(t->stack + THREAD_STACK_SIZE);
+        *--sp = 0;                              // Fake return address for bootstrap
+        *--sp = (uint32_t)thread_bootstrap;
+        *--sp = 0;                              // ebp (ends frame pointer chains)
+        *--sp = 0;                              // ebx
+        *--sp = 0;                              // esi
+        *--sp = 0;                              // edi
+        t->esp = (uint32_t)sp;
+    }
+
+    strncpy(t->name, name, THREAD_NAME_LEN - 1);
+    t->entry = entry;
+    t->arg = arg;
+    t->state = THREAD_READY;
+    t->slice_left = slice_for(0);
+
+    uint32_t flags = write_lock_irqsave(&threads_lock);
+    t->id = next_id++;
+    t->cpu = this_cpu()->index;
+    t->all_next = all_threads;
+    all_threads = t;
+    write_unlock_irqrestore(&threads_lock, flags);
+    return t;
+}
+
+// Make the running boot flow of this CPU a thread
+static struct thread* adopt_boot_flow(const char* name) {
+    struct thread* t = thread_alloc(name, 0, 0);
+    if (t) {
+        t->state = THREAD_RUNNING;
+        t->pinned = 1;
+        t->on_cpu = 1;
+        this_cpu()->current = t;
+    }
+    return t;
+}
+
+// Application processor tick (and profiler samples, which may come faster)
+static int lapic_timer_irq(void* ctx) {
+    (void)ctx;
+    // On the boot CPU it may instead end a long tickless idle period
+    if (timer_lapic_irq()) {
+        return IRQ_HANDLED;
+    }
+    if (profile_lapic_tick()) {
+        thread_tick();
+    }
+    return IRQ_HANDLED;
+}
+
+// Reschedule IPI: need_resched is already set, thread_preempt does the rest
+static int resched_irq(void* ctx) {
+    (void)ctx;
+    return IRQ_HANDLED;
+}
+
+void thread_init(void) {
+    struct run_queue* rq = this_rq();
+    thread_cache = kmem_cache_create("thread", sizeof(struct thread));
+
+    // The boot thread runs the shell and stays on the boot CPU, which takes
+    // the keyboard interrupt
+    adopt_boot_flow("main");
+
+    rq->idle = thread_alloc("idle", idle_loop, 0);
+    rq->idle->pinned = 1;
+    rq->boost_countdown = SCHED_BOOST_TICKS;
+    rq->online_tsc = rdtsc();
+    atomic_or(&online_mask, 1u << this_cpu()->index);
+
+    irq_register_vector(LAPIC_TIMER_VECTOR, "lapic-timer", lapic_timer_irq, 0);
+    irq_register_vector(IPI_RESCHED_VECTOR, "resched", resched_irq, 0);
+}
+
+void thread_start_cpu(void) {
+    struct run_queue* rq = this_rq();
+    uint32_t index = this_cpu()->index;
+
+    // The AP's boot stack becomes its idle thread
+    rq->idle = adopt_boot_flow("idle");
+    if (rq->idle) {
+        rq->boost_countdown = SCHED_BOOST_TICKS;
+        rq->online_tsc = rq->idle_start = rdtsc();
+        atomic_or(&idle_mask, 1u << index);
+        atomic_or(&online_mask, 1u << index);
+        idle_loop(0);
+    }
+
+    // No thread slot left: this CPU stays out of scheduling
+    while (1) {
+        asm volatile("cli; hlt");
+    }
+}
+
+static struct thread* thread_spawn(const char* name, void (*entry)(void*), void* arg, int pinned) {
+    struct thread* t = thread_alloc(name, entry, arg);
+    if (t == 0) {
+        return 0;
+    }
+    t->pinned = pinned;
+
+    uint32_t flags = irq_save();
+    run_queue_push(this_rq(), t);
+    irq_restore(flags);
+    return t;
+}
+
+struct thread* thread_create(const char* name, void (*entry)(void*), void* arg) {
+    return thread_spawn(name, entry, arg, 0);
+}
+
+struct thread* thread_create_pinned(const char* name, void (*entry)(void*), void* arg) {
+    return thread_spawn(name, entry, arg, 1);
+}
+
+struct thread* thread_current(void) {
+    return this_cpu_read(current);
+}
+
+void thread_yield(void) {
+    uint32_t flags = irq_save();
+    schedule();
+    irq_restore(flags);
+}
+
+void thread_block(void) {
+    struct thread* self = this_cpu()->current;
+
+    spin_lock(&wake_lock);
+    if (self->wake_pending) {
+        self->wake_pending = 0;
+        spin_unlock(&wake_lock);
+        return;
+    }
+    self->state = THREAD_BLOCKED;
+    spin_unlock(&wake_lock);
+
+    schedule();
+}
+
+int thread_wake(struct thread* t) {
+    uint32_t flags = spin_lock_irqsave(&wake_lock);
+    if (t->state != THREAD_BLOCKED) {
+        // Not asleep (yet): make its next thread_block return at once
+        t->wake_pending = 1;
+        spin_unlock_irqrestore(&wake_lock, flags);
+        return 0;
+    }
+    t->state = THREAD_READY;
+    spin_unlock(&wake_lock);
+
+    // It may still be switching out on another CPU
+    while (t->on_cpu) {
+        cpu_relax();
+    }
+
+    // Blocking marks the thread interactive: back to the top
+    struct run_queue* rq = this_rq();
+    t->priority = 0;
+    t->slice_left = slice_for(0);
+    rq->stats.wakeups++;
+    if (t->pinned && t->cpu != this_cpu()->index) {
+        inbox_push(&run_queues[t->cpu], t);
+        kick_cpu(t->cpu);
+    } else {
+        // Nothing runs above priority 0, so the woken thread preempts
+        run_queue_push(rq, t);
+        rq->need_resched = 1;
+    }
+    irq_restore(flags);
+    return 1;
+}
+
+void thread_exit(void) {
+    asm volatile("cli");
+    this_cpu()->current->state = THREAD_DEAD;
+    schedule();
+
+    // A dead thread is never scheduled again
+    while (1) {
+        asm volatile("hlt");
+    }
+}
+
+void thread_tick(void) {
+    profile_tick();
+
+    struct thread* current = this_cpu()->current;
+    if (current == 0) {
+        return;
+    }
+
+    struct run_queue* rq = this_rq();
+    current->ticks++;
+    if (current == rq->idle) {
+        if (has_work(rq)) {
+            rq->need_resched = 1;
+        }
+    } else if (current->slice_left && --current->slice_left == 0) {
+        // Used the whole slice: CPU-bound, drop one level. Further ticks
+        // before the switch (irq_exit defers it while bottom halves are
+        // disabled) find the slice at zero and leave it there.
+        if (current->priority < SCHED_PRIORITIES - 1) {
+            current->priority++;
+        }
+        rq->need_resched = 1;
+    }
+
+    if (--rq->boost_countdown == 0) {
+        rq->boost_countdown = SCHED_BOOST_TICKS;
+        boost_all(rq);
+    }
+}
+
+int thread_idle_now(void) {
+    struct run_queue* rq = this_rq();
+    if (this_cpu()->current != rq->idle) {
+        return 0;
+    }
+
+    // Every online CPU in its idle thread, with nothing queued or pending
+    uint32_t online = online_mask;
+    if ((idle_mask & online) != online) {
+        return 0;
+    }
+    while (online) {
+        uint32_t cpu = bsf(online);
+        online &= online - 1;
+        rq = &run_queues[cpu];
+        if (rq->ready_mask || rq->inbox || rq->need_resched) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void thread_preempt(void) {
+    struct run_queue* rq = this_rq();
+    if (rq->need_resched && this_cpu()->current) {
+        rq->stats.preemptions++;
+        schedule();
+    }
+}
+
+uint32_t thread_context_switches(void) {
+    uint32_t switches = 0;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        switches += run_queues[i].stats.context_switches;
+    }
+    return switches;
+}
+
+// Snapshot of the index-th thread, returns 0 past the end
+int thread_get_info(uint32_t index, struct thread_info* out) {
+    uint32_t flags = read_lock_irqsave(&threads_lock);
+    struct thread* t = all_threads;
+    while (t && index > 0) {
+        t = t->all_next;
+        index--;
+    }
+
+    if (t) {
+        out->id = t->id;
+        out->state = t->state;
+        memcpy(out->name, t->name, THREAD_NAME_LEN);
+        out->priority = t->priority;
+        out->cpu = t->cpu;
+        out->switches = t->switches;
+        out->ticks = t->ticks;
+    }
+    read_unlock_irqrestore(&threads_lock, flags);
+    return t != 0;
+}
+
+// Sums of every CPU's counters (each read without stopping its owner)
+void sched_get_stats(struct sched_stats* out) {
+    memset(out, 0, sizeof(*out));
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        const struct run_queue* rq = &run_queues[i];
+        if (!(online_mask & (1u << i))) {
+            continue;
+        }
+
+        out->context_switches += rq->stats.context_switches;
+        out->preemptions += rq->stats.preemptions;
+        out->wakeups += rq->stats.wakeups;
+        out->boosts += rq->stats.boosts;
+        out->latency_samples += rq->stats.latency_samples;
+        out->latency_cycles += rq->stats.latency_cycles;
+        if (rq->stats.latency_max > out->latency_max) {
+            out->latency_max = rq->stats.latency_max;
+        }
+        out->steals += rq->stats.steals;
+        out->migrations += rq->stats.migrations;
+        for (uint32_t p = 0; p < SCHED_PRIORITIES; p++) {
+            out->queue_length[p] += deque_size(&rq->deques[p]);
+        }
+    }
+}
+
+int sched_get_cpu_stats(uint32_t cpu, struct sched_cpu_stats* out) {
+    if (cpu >= MAX_CPUS || !(online_mask & (1u << cpu))) {
+        return 0;
+    }
+
+    const struct run_queue* rq = &run_queues[cpu];
+    uint64_t now = rdtsc();
+    out->context_switches = rq->stats.context_switches;
+    out->steals = rq->stats.steals;
+    out->migrations = rq->stats.migrations;
+    out->runnable = 0;
+    for (uint32_t p = 0; p < SCHED_PRIORITIES; p++) {
+        out->runnable += deque_size(&rq->deques[p]);
+    }
+    out->idle_cycles = rq->idle_cycles;
+    if (cpu_data[cpu].current == rq->idle) {
+        out->idle_cycles += now - rq->idle_start;
+    }
+    out->online_cycles = now - rq->online_tsc;
+    return 1;
+}
@@ -1,20 +1,224 @@
 #include "include/timer.h"
 #include "include/port_io.h"
 #include "include/idt.h"
+#include "include/thread.h"
+#include "include/cpu.h"
+#include "include/timer_wheel.h"
+#include "include/tsc.h"
+#include "include/div64.h"
+#include "include/apic.h"
+#include "include/percpu.h"
+#include "include/profile.h"
 
 // Incremented atomically on each IRQ0, must be volatile for ISR visibility
 static volatile uint32_t timer_ticks = 0;
 static uint32_t timer_frequency = 0;
+static uint32_t timer_divisor = 0;
+
+// Tickless idle
+//
+// When a tick finds every CPU with only its idle thread to run, channel 0 is
+// switched to a one-shot (mode 0) covering every tick until the timer wheel
+// next needs to run. Since this is programmed right at a tick, the one-shot
+// firing means exactly that many ticks passed. Another interrupt arriving
+// first latches the count to add the whole ticks that passed, then a short
+// one-shot runs to the end of the current tick so the periodic phase is kept.
+// A 16-bit count limits one idle period to 65535 PIT clocks (5 ticks at
+// 100 Hz).
+//
+// Longer idle periods use the boot CPU's LAPIC timer instead, once it is
+// calibrated and the profiler is not using it: its 32-bit count covers
+// minutes, so the wheel's next timer (or root wrap) is the only limit. The
+// PIT is stopped meanwhile and restarts periodic from the tick that ends
+// the one-shot; an early wakeup aligns to the tick on a short PIT one-shot
+// as above. hlt only enters C1, where the LAPIC timer keeps counting.
+//
+// The tick and the timer wheel belong to the boot CPU, so the tick only
+// stops while all CPUs are idle: the application processors then run no
+// code that arms timers or reads the tick count, and anything that wakes
+// them starts from an interrupt here, whose timer_irq_enter catches up
+// first.
+//
+// An application processor's tick only looks for work, which queuing a
+// thread announces with a reschedule IPI anyway. So when an AP is about to
+// halt with nothing to run or steal it stops its LAPIC timer (unless the
+// profiler has it running faster), and restarts it periodic when it
+// switches away from its idle thread. The ticks it skipped are counted
+// against the boot CPU's tick count, which is current whenever an AP can
+// be woken.
+enum tick_mode {
+    TICK_PERIODIC,
+    TICK_IDLE,                   // One-shot over oneshot_ticks idle ticks
+    TICK_IDLE_LAPIC,             // The same on the LAPIC timer, PIT stopped
+    TICK_ALIGN,                  // One-shot to the end of a partly elapsed tick
+};
+
+static enum tick_mode tick_mode = TICK_PERIODIC;
+static int tickless_enabled = 1;
+static uint32_t oneshot_ticks = 0;
+static uint32_t oneshot_count = 0;
+static struct tickless_stats tickless;
+
+// Stopped tick of an application processor (written by that CPU only)
+struct ap_tick {
+    uint32_t stopped;
+    uint32_t stopped_at;         // timer_ticks when it stopped
+    uint32_t stops;
+    uint32_t avoided;
+} __attribute__((aligned(64)));
+
+static struct ap_tick ap_ticks[MAX_CPUS];
+
+static void pit_program(uint8_t command, uint32_t count) {
+    outb(PIT_COMMAND, command);
+    outb(PIT_CHANNEL0, (uint8_t)(count & 0xFF));
+    outb(PIT_CHANNEL0, (uint8_t)((count >> 8) & 0xFF));
+}
+
+// Mode 0 holds the output low until a count is written: no more IRQ0s
+static void pit_stop(void) {
+    outb(PIT_COMMAND, PIT_CMD_ONESHOT);
+}
+
+static uint32_t pit_read_count(void) {
+    outb(PIT_COMMAND, PIT_CMD_LATCH);
+    uint32_t low = inb(PIT_CHANNEL0);
+    uint32_t high = inb(PIT_CHANNEL0);
+    return (high << 8) | low;
+}
+
+// One tick: from IRQ0, or from the LAPIC timer ending an idle one-shot
+static void timer_tick(void) {
+    // The one-shot covered oneshot_ticks ticks, this interrupt is the last
+    if (tick_mode == TICK_IDLE || tick_mode == TICK_IDLE_LAPIC) {
+        timer_ticks += oneshot_ticks - 1;
+        tickless.avoided += oneshot_ticks - 1;
+    }
 
-// IRQ0 callback - increment tick counter
-void timer_handler(void) {
     timer_ticks++;
+
+    // Run every timer due this tick (wakes exactly the sleepers whose time has come)
+    timer_wheel_run(timer_ticks);
+
+    thread_tick();
+
+    // Stop the tick while idle, otherwise make sure it is periodic again.
+    // thread_tick has already moved the profiler to its current rate.
+    uint32_t lapic_count = lapic_timer_tick_count();
+    int use_lapic = lapic_count != 0 && !profile_lapic_busy();
+    uint32_t max_ticks = use_lapic ? 0xFFFFFFFF / lapic_count : 65535 / timer_divisor;
+    uint32_t idle_ticks = 0;
+    if (tickless_enabled && max_ticks > 1 && thread_idle_now()) {
+        idle_ticks = timer_wheel_idle_ticks(max_ticks);
+    }
+
+    if (idle_ticks > 1 && use_lapic) {
+        oneshot_ticks = idle_ticks;
+        oneshot_count = idle_ticks * lapic_count;
+        pit_stop();
+        lapic_timer_oneshot(oneshot_count);
+        tick_mode = TICK_IDLE_LAPIC;
+        tickless.oneshots++;
+        tickless.lapic_oneshots++;
+    } else if (idle_ticks > 1) {
+        oneshot_ticks = idle_ticks;
+        oneshot_count = idle_ticks * timer_divisor;
+        pit_program(PIT_CMD_ONESHOT, oneshot_count);
+        tick_mode = TICK_IDLE;
+        tickless.oneshots++;
+    } else if (tick_mode != TICK_PERIODIC) {
+        pit_program(PIT_CMD_PERIODIC, timer_divisor);
+        tick_mode = TICK_PERIODIC;
+    }
+}
+
+// IRQ0 handler - increment tick counter and charge the running thread
+static int timer_irq(void* ctx) {
+    (void)ctx;
+    timer_tick();
+    return IRQ_HANDLED;
+}
+
+int timer_lapic_irq(void) {
+    if (tick_mode != TICK_IDLE_LAPIC || this_cpu()->index != 0) {
+        return 0;
+    }
+    timer_tick();
+    return 1;
+}
+
+// Another interrupt ended an idle one-shot early: catch up on the ticks it skipped
+void timer_irq_enter(void) {
+    uint32_t ticks, align;
+    if (tick_mode == TICK_IDLE) {
+        // A count above the programmed one means it already fired and IRQ0 is pending
+        uint32_t remaining = pit_read_count();
+        if (remaining > oneshot_count) {
+            return;
+        }
+
+        uint32_t elapsed = oneshot_count - remaining;
+        ticks = elapsed / timer_divisor;
+        align = timer_divisor - elapsed % timer_divisor;
+    } else if (tick_mode == TICK_IDLE_LAPIC) {
+        // At zero it has fired and its interrupt is pending
+        uint32_t remaining = lapic_timer_remaining();
+        if (remaining == 0) {
+            return;
+        }
+        lapic_timer_set_rate(0);
+
+        uint32_t lapic_count = lapic_timer_tick_count();
+        uint32_t elapsed = oneshot_count - remaining;
+        ticks = elapsed / lapic_count;
+        align = (uint32_t)div_u64((uint64_t)(lapic_count - elapsed % lapic_count) * timer_divisor,
+                                  lapic_count);
+    } else {
+        return;
+    }
+
+    timer_ticks += ticks;
+    tickless.avoided += ticks;
+    tickless.early_wakes++;
+
+    // Nothing is due before the one-shot would have fired; this only moves
+    // the wheel to the current tick so new timers are armed relative to it
+    timer_wheel_run(timer_ticks);
+
+    pit_program(PIT_CMD_ONESHOT, align ? align : 1);
+    tick_mode = TICK_ALIGN;
+}
+
+void timer_idle_enter(void) {
+    uint32_t cpu = this_cpu()->index;
+    struct ap_tick* ap = &ap_ticks[cpu];
+    if (cpu == 0 || ap->stopped || !tickless_enabled || profile_lapic_busy()) {
+        return;
+    }
+    if (lapic_timer_set_rate(0)) {
+        ap->stopped = 1;
+        ap->stopped_at = timer_ticks;
+        ap->stops++;
+    }
+}
+
+void timer_idle_exit(void) {
+    struct ap_tick* ap = &ap_ticks[this_cpu()->index];
+    if (!ap->stopped) {
+        return;
+    }
+    lapic_timer_start();
+    ap->stopped = 0;
+    ap->avoided += timer_ticks - ap->stopped_at;
 }
 
 // Configure PIT channel 0 for periodic interrupts at specified Hz
 void timer_init(uint32_t frequency) {
     timer_frequency = frequency;
 
+    // Calibrate the TSC on channel 2 before channel 0 starts ticking
+    tsc_init();
+
     // Calculate divisor for desired frequency
     uint32_t divisor = PIT_FREQUENCY / frequency;
 
@@ -26,16 +230,16 @@ void timer_init(uint32_t frequency) {
         divisor = 1;
     }
 
+    timer_divisor = divisor;
+
     // Configure PIT: channel 0, lobyte/hibyte access, mode 3 (square wave), binary
     // Bits [7:6]=00 (channel 0), [5:4]=11 (lobyte/hibyte), [3:1]=011 (mode 3), [0]=0 (binary)
-    outb(PIT_COMMAND, 0x36);
+    // The 16-bit divisor is written as two 8-bit writes (LSB first)
+    pit_program(PIT_CMD_PERIODIC, divisor);
 
-    // Write 16-bit divisor as two 8-bit writes (LSB first)
-    outb(PIT_CHANNEL0, (uint8_t)(divisor & 0xFF));
-    outb(PIT_CHANNEL0, (uint8_t)((divisor >> 8) & 0xFF));
-
-    // Unmask IRQ0 in PIC to enable timer interrupts
-    pic_clear_mask(0);
+    // Unmask IRQ0 at the interrupt controller to enable timer interrupts
+    irq_register(0, "timer", timer_irq, 0);
+    irq_unmask(0);
 }
 
 // Atomic read of tick counter
@@ -43,6 +247,10 @@ uint32_t timer_get_ticks(void) {
     return timer_ticks;
 }
 
+uint32_t timer_get_frequency(void) {
+    return timer_frequency;
+}
+
 // Convert ticks to seconds using configured frequency
 uint32_t timer_get_uptime_seconds(void) {
     if (timer_frequency == 0) {
@@ -51,12 +259,89 @@ uint32_t timer_get_uptime_seconds(void) {
     return timer_ticks / timer_frequency;
 }
 
-// Sleep by halting CPU until target tick count reached
+static void sleep_expired(void* arg) {
+    thread_wake((struct thread*)arg);
+}
+
+// Block the calling thread until the target tick count is reached
 void timer_sleep(uint32_t ticks) {
-    uint32_t end_tick = timer_ticks + ticks;
+    if (ticks == 0) {
+        return;
+    }
+
+    struct timer timer;
+    timer_setup(&timer, sleep_expired, thread_current());
+
+    uint32_t flags = irq_save();
+    timer_add(&timer, ticks);
+
+    // A wakeup meant for an earlier sleep can end thread_block early
+    while (timer_pending(&timer)) {
+        thread_block();
+    }
+    irq_restore(flags);
+
+    // The callback may still be running on another CPU; the timer is on our stack
+    timer_cancel_sync(&timer);
+}
+
+uint64_t timer_get_ns(void) {
+    if (tsc_get_khz()) {
+        return tsc_get_ns();
+    }
+    // Before timer_init (early klog records) there is no time yet
+    if (timer_frequency == 0) {
+        return 0;
+    }
+    return (uint64_t)timer_ticks * (1000000000 / timer_frequency);
+}
+
+void timer_delay_us(uint32_t us) {
+    uint32_t khz = tsc_get_khz();
+    if (khz == 0) {
+        // No clocksource finer than a tick
+        timer_sleep((uint32_t)div_u64((uint64_t)us * timer_frequency + 999999, 1000000));
+        return;
+    }
+
+    uint64_t end = rdtsc() + div_u64((uint64_t)us * khz, 1000);
+    while ((int64_t)(rdtsc() - end) < 0) {
+        cpu_relax();
+    }
+}
+
+void timer_sleep_us(uint32_t us) {
+    uint32_t tick_us = 1000000 / timer_frequency;
+    uint64_t end = timer_get_ns() + (uint64_t)us * 1000;
+
+    // Block for the ticks that surely fit, leaving at most one tick to spin
+    if (us >= 2 * tick_us) {
+        timer_sleep(us / tick_us - 1);
+    }
+
+    uint64_t now = timer_get_ns();
+    if (now < end) {
+        timer_delay_us((uint32_t)div_u64(end - now, 1000));
+    }
+}
+
+void timer_set_tickless(int enabled) {
+    tickless_enabled = enabled;
+}
+
+int timer_get_tickless(void) {
+    return tickless_enabled;
+}
+
+void timer_get_tickless_stats(struct tickless_stats* out) {
+    uint32_t flags = irq_save();
+    *out = tickless;
+    irq_restore(flags);
 
-    // HLT reduces power consumption while waiting for IRQ
-    while (timer_ticks < end_tick) {
-        asm volatile("hlt");
+    out->ap_stops = 0;
+    out->ap_avoided = 0;
+    for (uint32_t cpu = 1; cpu < MAX_CPUS; cpu++) {
+        out->ap_stops += ap_ticks[cpu].stops;
+        out->ap_avoided += ap_ticks[cpu].avoided;
     }
 }
@@ -0,0 +1,191 @@
+#include "include/timer_wheel.h"
+#include "include/cpu.h"
+#include "include/spinlock.h"
+#include "include/string.h"
+
+// Hierarchical timer wheel
+//
+// Timers due within the next 256 ticks sit in the root wheel, one slot per
+// tick. Later ones go into one of four 64-slot levels, each slot covering 64
+// times the span of a slot one level down. Arming and cancelling are a list
+// insert or unlink. Every 256 ticks the next slot of level 1 is cascaded into
+// the root wheel (and, as levels wrap, higher levels into lower ones), so
+// each timer is moved at most once per level before it expires. Each tick
+// then runs its whole root slot as one batch.
+//
+// Any CPU may arm or cancel timers; wheel_lock covers the wheel, and is
+// dropped around each callback so callbacks can re-arm.
+
+#define ROOT_SIZE   (1u << TIMER_WHEEL_ROOT_BITS)
+#define ROOT_MASK   (ROOT_SIZE - 1)
+#define LEVEL_SIZE  (1u << TIMER_WHEEL_LEVEL_BITS)
+#define LEVEL_MASK  (LEVEL_SIZE - 1)
+
+// Shift selecting a level's slot index from an expiry tick
+#define LEVEL_SHIFT(level) (TIMER_WHEEL_ROOT_BITS + (level) * TIMER_WHEEL_LEVEL_BITS)
+
+static struct timer* root[ROOT_SIZE];
+static struct timer* levels[TIMER_WHEEL_LEVELS][LEVEL_SIZE];
+
+// Next tick the wheel will process (the tick counter starts at 0, first tick is 1)
+static uint32_t wheel_tick = 1;
+static struct timer_wheel_stats stats;
+static LOCK_CLASS(wheel_class, "timer-wheel");
+static struct spinlock wheel_lock = SPINLOCK_INIT(&wheel_class);
+
+// Timer whose callback is running, for timer_cancel_sync
+static struct timer* volatile running_timer = 0;
+
+static void list_add(struct timer** head, struct timer* timer) {
+    timer->next = *head;
+    if (*head) {
+        (*head)->pprev = &timer->next;
+    }
+    *head = timer;
+    timer->pprev = head;
+}
+
+static void list_del(struct timer* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = 0;
+    timer->pprev = 0;
+}
+
+// Slot for a timer given the current wheel position
+static void wheel_insert(struct timer* timer) {
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - wheel_tick;
+
+    if ((int32_t)delta < 0) {
+        // Already due: run on the next tick processed
+        list_add(&root[wheel_tick & ROOT_MASK], timer);
+    } else if (delta < ROOT_SIZE) {
+        list_add(&root[expires & ROOT_MASK], timer);
+    } else {
+        uint32_t level = 0;
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1u << LEVEL_SHIFT(level + 1))) {
+            level++;
+        }
+        list_add(&levels[level][(expires >> LEVEL_SHIFT(level)) & LEVEL_MASK], timer);
+    }
+}
+
+// Re-insert every timer of one level slot, returns the slot index
+static uint32_t cascade(uint32_t level) {
+    uint32_t index = (wheel_tick >> LEVEL_SHIFT(level)) & LEVEL_MASK;
+    struct timer* timer = levels[level][index];
+    levels[level][index] = 0;
+
+    while (timer) {
+        struct timer* next = timer->next;
+        timer->pprev = 0;
+        wheel_insert(timer);
+        stats.cascaded++;
+        timer = next;
+    }
+    return index;
+}
+
+void timer_setup(struct timer* timer, void (*callback)(void*), void* arg) {
+    memset(timer, 0, sizeof(*timer));
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+void timer_add(struct timer* timer, uint32_t delay) {
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    if (timer->pprev) {
+        list_del(timer);
+        stats.pending--;
+    }
+    // wheel_tick - 1 is the current tick, also inside callbacks
+    timer->expires = wheel_tick - 1 + delay;
+    wheel_insert(timer);
+    stats.pending++;
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
+
+int timer_cancel(struct timer* timer) {
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    int was_pending = timer->pprev != 0;
+    if (was_pending) {
+        list_del(timer);
+        stats.pending--;
+    }
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    return was_pending;
+}
+
+int timer_cancel_sync(struct timer* timer) {
+    int was_pending = timer_cancel(timer);
+    while (running_timer == timer) {
+        cpu_relax();
+    }
+    return was_pending;
+}
+
+void timer_wheel_run(uint32_t now) {
+    spin_lock(&wheel_lock);
+    while ((int32_t)(now - wheel_tick) >= 0) {
+        uint32_t index = wheel_tick & ROOT_MASK;
+
+        // Root wheel wrapped: pull the next slot of each level that wrapped too
+        if (index == 0) {
+            for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+                if (cascade(level) != 0) {
+                    break;
+                }
+            }
+        }
+
+        // Detach the slot so callbacks can re-arm or cancel freely
+        struct timer* batch = root[index];
+        root[index] = 0;
+        if (batch) {
+            batch->pprev = &batch;
+        }
+        wheel_tick++;
+
+        while (batch) {
+            struct timer* timer = batch;
+            void (*callback)(void*) = timer->callback;
+            void* arg = timer->arg;
+            list_del(timer);
+            stats.pending--;
+            stats.expired++;
+
+            // Once unlinked the timer is not touched again, its owner may free it
+            running_timer = timer;
+            spin_unlock(&wheel_lock);
+            callback(arg);
+            spin_lock(&wheel_lock);
+            running_timer = 0;
+        }
+    }
+    spin_unlock(&wheel_lock);
+}
+
+uint32_t timer_wheel_idle_ticks(uint32_t max) {
+    uint32_t ticks = max;
+
+    spin_lock(&wheel_lock);
+    for (uint32_t k = 0; k < max; k++) {
+        // A root wrap may cascade timers that are due right away
+        uint32_t index = (wheel_tick + k) & ROOT_MASK;
+        if (root[index] || index == 0) {
+            ticks = k + 1;
+            break;
+        }
+    }
+    spin_unlock(&wheel_lock);
+    return ticks;
+}
+
+void timer_wheel_get_stats(struct timer_wheel_stats* out) {
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    memcpy(out, &stats, sizeof(stats));
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
@@ -0,0 +1,83 @@
+# Application processor startup trampoline
+#
+# Copied to TRAMPOLINE_BASE (physical) by smp_init; a STARTUP IPI starts an
+# AP in real mode at that address. It loads a flat GDT, enters protected
+# mode, turns on paging with the boot page directory (which identity maps
+# this page and maps the kernel in the higher half) and jumps to the C entry
+# point on the stack smp_init prepared. Everything is addressed relative to
+# TRAMPOLINE_BASE since the code does not run where it was linked.
+
+.set TRAMPOLINE_BASE, 0x8000       # Must match kernel/include/smp.h
+.set CR0_PE,          0x00000001
+.set CR0_PG_WP,       0x80010000
+.set CR4_PSE,         0x00000010
+
+.section .text
+.code16
+.global trampoline_start
+trampoline_start:
+    cli
+    cld
+    xor %ax, %ax
+    mov %ax, %ds
+
+    lgdtl (tramp_gdtr - trampoline_start + TRAMPOLINE_BASE)
+    mov %cr0, %eax
+    or $CR0_PE, %eax
+    mov %eax, %cr0
+    ljmpl $0x08, $(tramp_protected - trampoline_start + TRAMPOLINE_BASE)
+
+.code32
+tramp_protected:
+    mov $0x10, %ax
+    mov %ax, %ds
+    mov %ax, %es
+    mov %ax, %ss
+    mov %ax, %fs
+    mov %ax, %gs
+
+    # Same paging setup as _start in boot.s
+    mov %cr4, %eax
+    or $CR4_PSE, %eax
+    mov %eax, %cr4
+    mov (tramp_cr3 - trampoline_start + TRAMPOLINE_BASE), %eax
+    mov %eax, %cr3
+    mov %cr0, %eax
+    or $CR0_PG_WP, %eax
+    mov %eax, %cr0
+
+    # ap_main(cpu index) on the AP's own stack, never returns
+    mov (tramp_stack - trampoline_start + TRAMPOLINE_BASE), %esp
+    xor %ebp, %ebp
+    pushl (tramp_cpu - trampoline_start + TRAMPOLINE_BASE)
+    pushl $0                       # No return address
+    mov (tramp_entry - trampoline_start + TRAMPOLINE_BASE), %eax
+    jmp *%eax
+
+# Flat code and data segments, only used until ap_main loads the CPU's GDT
+.align 8
+tramp_gdt:
+    .quad 0
+    .quad 0x00CF9A000000FFFF       # 0x08: code, base 0, 4 GiB, 32-bit
+    .quad 0x00CF92000000FFFF       # 0x10: data, base 0, 4 GiB, 32-bit
+tramp_gdtr:
+    .word tramp_gdtr - tramp_gdt - 1
+    .long tramp_gdt - trampoline_start + TRAMPOLINE_BASE
+
+# Filled in by smp_init for each AP
+.align 4
+.global tramp_cr3
+tramp_cr3:
+    .long 0
+.global tramp_stack
+tramp_stack:
+    .long 0
+.global tramp_entry
+tramp_entry:
+    .long 0
+.global tramp_cpu
+tramp_cpu:
+    .long 0
+
+.global trampoline_end
+trampoline_end:
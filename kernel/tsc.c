@@ -0,0 +1,112 @@
+#include "include/tsc.h"
+#include "include/timer.h"
+#include "include/port_io.h"
+#include "include/cpu.h"
+#include "include/div64.h"
+#include "include/klog.h"
+
+// TSC clocksource
+//
+// The TSC rate is measured once at boot by timing a PIT channel 2 one-shot
+// (channel 0 keeps driving IRQ0). Reading the time is then one rdtsc and a
+// multiply-shift: ns = cycles * mult >> shift, with mult chosen as large as
+// fits in 32 bits for the best precision.
+
+static uint32_t tsc_khz = 0;
+static uint32_t tsc_mult = 0;
+static uint32_t tsc_shift = 0;
+static uint64_t tsc_base = 0;
+static int tsc_invariant = 0;
+
+// TSC cycles across one channel 2 one-shot of count PIT clocks, 0 if OUT2
+// never rose
+static uint64_t measure_once(uint32_t count) {
+    // Gate off and speaker off while programming
+    uint8_t port_b = inb(PIT_PORT_B) & ~(PIT_PORT_B_GATE2 | PIT_PORT_B_SPEAKER);
+    outb(PIT_PORT_B, port_b);
+
+    outb(PIT_COMMAND, PIT_CMD_CH2_ONESHOT);
+    outb(PIT_CHANNEL2, (uint8_t)(count & 0xFF));
+    outb(PIT_CHANNEL2, (uint8_t)((count >> 8) & 0xFF));
+
+    // Raising the gate starts the count; OUT2 goes high at terminal count
+    uint32_t flags = irq_save();
+    outb(PIT_PORT_B, port_b | PIT_PORT_B_GATE2);
+    uint64_t start = rdtsc();
+    uint64_t cycles = 0;
+    for (;;) {
+        int done = inb(PIT_PORT_B) & PIT_PORT_B_OUT2;
+        uint64_t elapsed = rdtsc() - start;
+        if (done) {
+            cycles = elapsed;
+            break;
+        }
+        if (elapsed > TSC_CALIBRATE_TIMEOUT) {
+            break;
+        }
+    }
+    irq_restore(flags);
+
+    outb(PIT_PORT_B, port_b);
+    return cycles;
+}
+
+uint32_t tsc_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_TSC)) {
+        return 0;
+    }
+
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000007) {
+        cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        tsc_invariant = (edx & CPUID_APM_EDX_INVARIANT_TSC) != 0;
+    }
+
+    // Interrupts or emulation hiccups only ever make a run longer
+    uint32_t count = PIT_FREQUENCY / 1000 * TSC_CALIBRATE_MS;
+    uint64_t best = 0;
+    for (uint32_t i = 0; i < TSC_CALIBRATE_RUNS; i++) {
+        uint64_t cycles = measure_once(count);
+        if (cycles == 0) {
+            klog(KLOG_WARN, "tsc: PIT channel 2 did not count, no TSC clocksource");
+            return 0;
+        }
+        if (best == 0 || cycles < best) {
+            best = cycles;
+        }
+    }
+
+    // kHz = cycles / (count / PIT_FREQUENCY) / 1000
+    tsc_khz = (uint32_t)div_u64(best * PIT_FREQUENCY, count * 1000);
+    if (tsc_khz == 0) {
+        return 0;
+    }
+
+    // Largest shift whose multiplier (ns per cycle << shift) fits in 32 bits
+    tsc_shift = 32;
+    while (tsc_shift > 0 && div_u64(1000000ull << tsc_shift, tsc_khz) > 0xFFFFFFFF) {
+        tsc_shift--;
+    }
+    tsc_mult = (uint32_t)div_u64(1000000ull << tsc_shift, tsc_khz);
+    tsc_base = rdtsc();
+    klog(KLOG_INFO, "tsc: %u kHz%s", tsc_khz, tsc_invariant ? ", invariant" : "");
+    return tsc_khz;
+}
+
+uint32_t tsc_get_khz(void) {
+    return tsc_khz;
+}
+
+int tsc_is_invariant(void) {
+    return tsc_invariant;
+}
+
+uint64_t tsc_to_ns(uint64_t cycles) {
+    return mul_u64_u32_shr(cycles, tsc_mult, tsc_shift);
+}
+
+uint64_t tsc_get_ns(void) {
+    return tsc_to_ns(rdtsc() - tsc_base);
+}
@@ -0,0 +1,96 @@
+#include "include/waitqueue.h"
+#include "include/cpu.h"
+
+// Wait queues
+//
+// A waiter links an entry on its own stack into the queue and blocks; wakers
+// unlink entries and make their threads ready. Nothing is allocated, so wait
+// queues can be used from interrupt handlers and by the allocators alike.
+// Waking is only a hint: the woken thread re-tests its condition, which keeps
+// spurious or shared wakeups harmless.
+
+LOCK_CLASS(wait_queue_class, "wait-queue");
+
+void wait_queue_init(struct wait_queue* wq) {
+    spin_lock_init(&wq->lock, &wait_queue_class);
+    wq->head = 0;
+    wq->tail = 0;
+}
+
+static struct wait_entry* dequeue(struct wait_queue* wq) {
+    struct wait_entry* entry = wq->head;
+    if (entry) {
+        wq->head = entry->next;
+        if (wq->head == 0) {
+            wq->tail = 0;
+        }
+        entry->queued = 0;
+    }
+    return entry;
+}
+
+// Unlink an entry wherever it is in the queue
+static void remove(struct wait_queue* wq, struct wait_entry* entry) {
+    struct wait_entry* prev = 0;
+    for (struct wait_entry* e = wq->head; e; prev = e, e = e->next) {
+        if (e != entry) {
+            continue;
+        }
+        if (prev) {
+            prev->next = e->next;
+        } else {
+            wq->head = e->next;
+        }
+        if (wq->tail == e) {
+            wq->tail = prev;
+        }
+        entry->queued = 0;
+        return;
+    }
+}
+
+void wait_queue_sleep(struct wait_queue* wq) {
+    struct wait_entry entry;
+    entry.thread = thread_current();
+    entry.next = 0;
+    entry.queued = 1;
+
+    if (wq->tail) {
+        wq->tail->next = &entry;
+    } else {
+        wq->head = &entry;
+    }
+    wq->tail = &entry;
+
+    // A waker that takes the entry before we block leaves a pending wakeup
+    spin_unlock(&wq->lock);
+    thread_block();
+    spin_lock(&wq->lock);
+
+    // Woken by something else: the entry must not outlive this frame
+    if (entry.queued) {
+        remove(wq, &entry);
+    }
+}
+
+int wake_up_one(struct wait_queue* wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    struct wait_entry* entry = dequeue(wq);
+    if (entry) {
+        thread_wake(entry->thread);
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return entry != 0;
+}
+
+uint32_t wake_up_all(struct wait_queue* wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    uint32_t woken = 0;
+    struct wait_entry* entry;
+    while ((entry = dequeue(wq)) != 0) {
+        thread_wake(entry->thread);
+        woken++;
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return woken;
+}
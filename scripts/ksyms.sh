@@ -0,0 +1,40 @@
+#!/bin/sh
+# Turn `nm -n` output on stdin into the kernel symbol table (GNU as, i386).
+# Only text symbols are kept, in address order; with no input the table is
+# empty, which is what the first link of the kernel uses.
+
+awk '
+BEGIN {
+    n = 0
+}
+$2 ~ /^[tTwW]$/ && $3 !~ /^\./ {
+    addr[n] = $1
+    name[n] = $3
+    n++
+}
+END {
+    print "    .section .rodata"
+    print "    .align 4"
+    print "    .globl ksym_count"
+    print "ksym_count:"
+    printf "    .long %d\n", n
+    print "    .globl ksym_addrs"
+    print "ksym_addrs:"
+    for (i = 0; i < n; i++) {
+        printf "    .long 0x%s\n", addr[i]
+    }
+    print "    .globl ksym_name_offsets"
+    print "ksym_name_offsets:"
+    offset = 0
+    for (i = 0; i < n; i++) {
+        printf "    .long %d\n", offset
+        offset += length(name[i]) + 1
+    }
+    print "    .globl ksym_names"
+    print "ksym_names:"
+    for (i = 0; i < n; i++) {
+        printf "    .asciz \"%s\"\n", name[i]
+    }
+    print "    .section .note.GNU-stack,\"\",@progbits"
+}
+'